@@ -1,3 +1,4 @@
+#include <atomic>
 #include <future> 
 #include <chrono>
 #include <iomanip>
@@ -7,170 +8,22 @@
 #include <vector>
 #include <string>
 #include <limits>
-#include <Windows.h>
+#include <functional>
+#include <map>
+#include <memory>
 #include <sstream>
 
-#include "rang.hpp"
-#include "OCR_font_STL.h"
+#include "Platform.h"
+#include "Fixture_Common.h"
+#include "Fixture_Mesh.h"
+#include "Fixture_Base.h"
+#include "Case_Archive.h"
+#include "Concurrency.h"
+#include "Plate_Nesting.h"
+#include "Output_Cache.h"
+#include "Output_Writer.h"
+#include "Stage_Stats.h"
 
-#include <CGAL/Polygon_mesh_processing/transform.h>
-#include <CGAL/Polygon_mesh_processing/measure.h>
-#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
-#include <CGAL/Polygon_mesh_processing/IO/polygon_mesh_io.h>
-#include <CGAL/Polygon_mesh_processing/corefinement.h>
-#include <CGAL/Surface_mesh.h>
-#include <CGAL/bounding_box.h>
-
-
-
-#define M_PI 3.14159265358979323846
-
-//<< Red << << ColorEnd <<
-auto ColorEnd = [](std::ostream& os) -> std::ostream& { return os << rang::fg::reset; };
-auto Red = [](std::ostream& os) -> std::ostream& { return os << rang::fg::red; };
-auto Green = [](std::ostream& os) -> std::ostream& { return os << rang::fg::green; };
-auto Yellow = [](std::ostream& os) -> std::ostream& { return os << rang::fg::yellow; };
-auto Blue = [](std::ostream& os) -> std::ostream& { return os << rang::fg::blue; };
-auto Magenta = [](std::ostream& os) -> std::ostream& { return os << rang::fg::magenta; };
-auto Cyan = [](std::ostream& os) -> std::ostream& { return os << rang::fg::cyan; };
-auto Gray = [](std::ostream& os) -> std::ostream& { return os << rang::fg::gray; };
-
-
-namespace PMP = CGAL::Polygon_mesh_processing;
-namespace fs = std::filesystem;
-bool DEBUG = false;
-
-typedef CGAL::Exact_predicates_inexact_constructions_kernel Kernel;
-typedef CGAL::Surface_mesh<Kernel::Point_3> Mesh;
-typedef Kernel::Point_3 Point;
-typedef Kernel::Vector_3 Vector;
-
-void setConsoleSize(int width, int height) {
-	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE); // Get the standard output handle
-
-	COORD newSize;
-	newSize.X = width;
-	newSize.Y = 32766; // Maximal possible height for the console window
-	SetConsoleScreenBufferSize(hStdout, newSize);
-
-	SMALL_RECT windowSize;
-	windowSize.Top = 0;
-	windowSize.Left = 0;
-	windowSize.Right = width - 1;  // Width of the window
-	windowSize.Bottom = height - 1;  // Height of the window
-
-	if (!SetConsoleWindowInfo(hStdout, TRUE, &windowSize)) {
-		std::cerr << "Setting console window size failed." << std::endl;
-	}
-}
-
-void get_dimensions(Mesh mesh, double& modelWidth, double& modelLength, double& modelHeight) {
-	std::vector<Point> points;
-	for (auto v : mesh.vertices()) {
-		points.push_back(mesh.point(v));
-	}
-	Kernel::Iso_cuboid_3 bbox = CGAL::bounding_box(points.begin(), points.end());
-	modelWidth = static_cast<double>(bbox.xmax() - bbox.xmin());
-	modelLength = static_cast<double>(bbox.ymax() - bbox.ymin());
-	modelHeight = static_cast<double>(bbox.zmax() - bbox.zmin());
-	if (DEBUG) std::cout << Yellow << "      Dimensions:" << ColorEnd
-		<< "  (W"
-		<< modelWidth << "  L"
-		<< modelLength << "  H"
-		<< modelHeight << ")" << std::endl;
-}
-
-void scaleMesh(Mesh& mesh, double XYscale, double XYtopscale, double Zscale, double zThreshold) {
-	for (auto v : mesh.vertices()) {
-		Point& point = mesh.point(v);
-		double new_x, new_y, new_z;
-
-		if (point.z() > zThreshold) {
-			new_x = point.x() * XYtopscale;
-			new_y = point.y() * XYtopscale;
-		}
-		else {
-			new_x = point.x() * XYscale;
-			new_y = point.y() * XYscale;
-		}
-		new_z = point.z() * Zscale;
-		mesh.point(v) = Point(new_x, new_y, new_z);
-	}
-}
-
-void translate_mesh(Mesh& mesh, const Vector& translation_vector) {
-	if (DEBUG) std::cout << Yellow << "      Applying translation:  " << ColorEnd << translation_vector << std::endl;
-	for (auto v : mesh.vertices()) {
-		mesh.point(v) = mesh.point(v) + translation_vector;
-	}
-}
-
-bool write_STL(const std::string& filename, const Mesh& mesh) {
-	fs::path filepath(filename);
-	if (DEBUG) std::cout << Yellow << "      Writting STL file:  " << ColorEnd << filepath.filename() << std::endl;
-	if (!CGAL::IO::write_polygon_mesh(filename, mesh, CGAL::parameters::stream_precision(10))) {
-		std::cerr << Red << "Error: Cannot write the STL file:  " << ColorEnd << filepath.filename() << std::endl;
-		return false;
-	}
-	return true;
-}
-
-
-bool read_STL_data(const std::string& identifier, Mesh& mesh) {
-	mesh.clear();
-	for (const auto& data : FONT_STL) {
-		if (data.key == identifier) { // Convert char to string for comparison
-			if (DEBUG) std::cout << Yellow << "      Reading STL Data:  " << ColorEnd << identifier << std::endl;
-			std::istringstream iss(std::string(reinterpret_cast<const char*>(data.data), data.size), std::ios::binary);
-			if (CGAL::IO::read_STL(iss, mesh)) { // Ensure this matches the actual function available in CGAL
-				return true;
-			}
-			break;
-		}
-	}
-	std::cerr << Red << "      Error: No STL data available for:  " << ColorEnd << identifier << std::endl;
-	return false;
-}
-
-void create_fixture(std::string ID_Str, Mesh Fixture_Mesh, Mesh& Result_Mesh) {
-	bool lastWasDigit = false;
-	double offsetX = -6.5, offsetY = -7.5, offsetZ = 4.0;
-	double XYscale = 0.18, XYtopscale = 0.18, Zscale = 0.30;
-	double zThreshold = 0.1;
-	double Xspacing = 0.8, Yspacing = 2.9;
-	double zDepth = -0.7;
-	Mesh Tag_Mesh;
-
-	std::transform(ID_Str.begin(), ID_Str.end(), ID_Str.begin(), [](unsigned char c) { return std::toupper(c); });
-
-	for (char c : ID_Str) {
-		Mesh Letter_Mesh;
-		double FontWidth = 0.0, FontLength = 0.0, FontHeight = 0.0;
-
-		if (!read_STL_data(std::string(1, c), Letter_Mesh)) continue;
-
-		get_dimensions(Letter_Mesh, FontWidth, FontLength, FontHeight);
-
-		if (std::isdigit(c)) {
-			lastWasDigit = true;
-		}
-		else if (lastWasDigit) {
-			offsetY -= (FontLength * XYscale) + Yspacing;
-			offsetX = -6.35; // 0.15
-			lastWasDigit = false;
-		}
-
-		scaleMesh(Letter_Mesh, XYscale, XYtopscale, Zscale, zThreshold);
-		translate_mesh(Letter_Mesh, Kernel::Vector_3(offsetX, offsetY, offsetZ + zDepth));
-		offsetX += (FontWidth * XYscale) + Xspacing;
-		CGAL::copy_face_graph(Letter_Mesh, Tag_Mesh);
-	}
-
-	Result_Mesh.clear();
-	if (!PMP::corefine_and_compute_difference(Fixture_Mesh, Tag_Mesh, Result_Mesh)) {
-		std::cerr << Red << "      Subtraction operation failed." << ColorEnd << std::endl;
-	}
-}
 
 struct ModelType {
 	std::string FullName;
@@ -179,39 +32,68 @@ struct ModelType {
 	int count;
 };
 
-bool processModel(const std::string outputPath, int ID, const ModelType modelType, int index) {
+// Where finished fixtures go instead of one STL file each: the case 3MF or
+// the plate nester. Runs on an output thread.
+typedef std::function<bool(const std::string& id, Mesh& mesh)> Case_Sink;
+
+// Builds one fixture and hands it to the writer; processedCount goes up once the
+// file is on disk (or copied from the cache). With a sink the fixture goes
+// there instead of getting a file of its own.
+bool processModel(const std::string outputPath, int ID, const ModelType modelType, int index, const Fixture_Base_Params& base,
+	const TagLayout& layout, Output_Cache& cache, Output_Writer& writer, const Case_Sink& sink, std::atomic<int>& processedCount) {
 	std::string id = std::to_string(ID) + modelType.label + (index < 10 ? "0" : "") + std::to_string(index);
-	std::string Filename = id + "_F.stl";
+	std::string Filename = sink ? id : id + "_F.stl";
 	std::string output = outputPath + "/" + Filename;
+	std::string key = fixture_cache_key(id, layout, base);
+
+	if (sink) {
+		Mesh Cached_Mesh;
+		if (cache.fetch_mesh(key, Cached_Mesh)) {
+			std::cout << "      Cached:   " << Yellow << Filename << ColorEnd << " for " << Cyan << modelType.FullName << ColorEnd << std::endl;
+			writer.write([&sink, id](Mesh& mesh) { return sink(id, mesh); }, std::move(Cached_Mesh),
+				[&processedCount](bool ok) { if (ok) processedCount++; });
+			return true;
+		}
+	}
+	else if (cache.fetch(key, output)) {
+		std::cout << "      Cached:   " << Yellow << Filename << ColorEnd << " for " << Cyan << modelType.FullName << ColorEnd << std::endl;
+		processedCount++;
+		return true;
+	}
+
+	// Rejected before any mesh is loaded when the ID cannot fit the tag
+	if (!tag_fits(id, layout)) return false;
 
 	std::cout << "      Creating: " << Yellow << Filename << ColorEnd << " for " << Cyan << modelType.FullName << ColorEnd << std::endl;
 
 	Mesh Fixture_Mesh, Result_Mesh;
 
-	if (!read_STL_data("fixture", Fixture_Mesh)) return false;
+	if (!load_fixture_base(base, Fixture_Mesh)) return false;
 
-	create_fixture(id, Fixture_Mesh, Result_Mesh);
+	Stage_Stats::instance().begin_fixture(id);
+	if (!create_fixture(id, std::move(Fixture_Mesh), Result_Mesh, layout)) {
+		Stage_Stats::instance().end_fixture();
+		return false;
+	}
 
-	if (!write_STL(output, Result_Mesh)) return false;
+	// The writer takes the open fixture and ends it once the file is written
+	if (sink) {
+		writer.write([&sink, &cache, id, key](Mesh& mesh) {
+			cache.store_mesh(key, mesh);
+			return sink(id, mesh);
+		}, std::move(Result_Mesh), [&processedCount](bool ok) { if (ok) processedCount++; });
+		return true;
+	}
+	writer.write(output, std::move(Result_Mesh), [&cache, &processedCount, key, output](bool ok) {
+		if (!ok) return;
+		cache.store(key, output);
+		processedCount++;
+	});
 	return true;
 }
 
 void displayUserName() {
-	char* username = nullptr;
-	char* userdomain = nullptr;
-	size_t sizeUsername = 0;
-	size_t sizeUserdomain = 0;
-
-	_dupenv_s(&username, &sizeUsername, "USERNAME");
-	_dupenv_s(&userdomain, &sizeUserdomain, "USERDOMAIN");
-
-	std::cout << "\n      USERNAME: "
-		<< (userdomain ? userdomain : "Unknown") << "\\"
-		<< (username ? username : "Unknown") << std::endl;
-
-	// Free the allocated memory
-	free(username);
-	free(userdomain);
+	std::cout << "\n      USERNAME: " << current_user() << std::endl;
 }
 
 void promptForNumbers(const std::string& prompt, int& outValue) {
@@ -239,9 +121,49 @@ void promptForNumbers(const std::string& prompt, int& outValue) {
 }
 
 
+// Maps the answer for one model type (a count, a 0/1 flag or a step number)
+// onto its index range; shared by the prompts and the command line.
+void applyModelAnswer(ModelType& model, int value) {
+	if (model.FullName == "UPPER" || model.FullName == "LOWER") {
+		model.count = value;
+	}
+	else if (model.FullName.find("RETAINER") != std::string::npos || model.FullName.find("TEMPLATE") != std::string::npos) {
+		model.initialCount = value == 0 ? 1 : 0;
+	}
+	else if (model.FullName.find("PASSIVE") != std::string::npos) {
+		if (value == 0) model.initialCount = 1;
+		else model.count = model.initialCount = value;
+	}
+}
+
+void printUsage() {
+	std::cout << "      Usage: AB_FIXTURE_CREATOR -C caseID [-UN n] [-UR 0|1] [-UT 0|1] [-UP step]\n"
+		<< "                                          [-LN n] [-LR 0|1] [-LT 0|1] [-LP step]\n"
+		<< "                                          [-FB width,length,height] [-FONT outlines.txt] [-3MF 1]\n"
+		<< "                                          [-NEST width,length[,spacing]] [-T|--threads n] [-CO 1]\n"
+		<< "      Without -C the tool asks for every value on the console.\n"
+		<< "      -FB builds a block base of that size (mm) instead of the standard fixture; it must hold the\n"
+		<< "          tag plate (x -13.5..13.5, y -16..-4.2 around the centre 0,3) with 1 mm to spare.\n"
+		<< "      -FONT engraves with the glyph outlines of a font file instead of the built-in ones.\n"
+		<< "      -3MF 1 writes every fixture of the case into one caseID.3mf instead of one STL each, laid out\n"
+		<< "          side by side on plates of the default -NEST size.\n"
+		<< "      -NEST packs the fixtures onto build plates of that size (mm), one caseID_plateN file per plate.\n"
+		<< "      -T limits the worker threads of the booleans, 0 (default) uses every core.\n"
+		<< "      -CO 1 sorts vertices and faces canonically, so the same geometry always gives the same STL bytes." << std::endl;
+}
+
 int main(int argc, char* argv[]) {
+	std::map<std::string, std::string> args;
+	for (int i = 1; i + 1 < argc; i += 2) args[argv[i]] = argv[i + 1];
+
+	// With -C everything comes from the command line, so the tool runs unattended.
+	bool interactive = !args.count("-C");
+	if (interactive && !console_attached()) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
 
-	setConsoleSize(73, 35);
+	if (interactive) setConsoleSize(73, 35);
 	std::cout << Cyan << "\n===========================" << ColorEnd 
 		<< Yellow << "'Created by Banna'" << ColorEnd
 		<< Cyan <<		   "===========================" << ColorEnd << std::endl;
@@ -250,12 +172,9 @@ int main(int argc, char* argv[]) {
 		<< Cyan<<		   "======================" << ColorEnd << std::endl;
 	std::cout << Cyan << "========================================================================\n" << ColorEnd << std::endl;
 
-
-	
-	
-
-	int caseID;
-	promptForNumbers("      What is the Case ID? (6 Numbers)             ", caseID);
+	int caseID = 0;
+	if (interactive) promptForNumbers("      What is the Case ID? (6 Numbers)             ", caseID);
+	else caseID = std::atoi(args["-C"].c_str());
 
 	std::string outputPath = fs::current_path().string() + "/" + std::to_string(caseID);
 	if (!fs::exists(outputPath)) {
@@ -276,55 +195,121 @@ int main(int argc, char* argv[]) {
 	};
 
 	for (auto& model : models) {
-		if (model.FullName == "UPPER" || model.FullName == "LOWER") {
-			promptForNumbers("       How many " + model.FullName + "? (Numbers)                   ", model.count);
+		int value = 0;
+		if (!interactive) {
+			if (args.count("-" + model.label)) value = std::atoi(args["-" + model.label].c_str());
 		}
-
-		if (model.FullName.find("RETAINER") != std::string::npos || model.FullName.find("TEMPLATE") != std::string::npos) {
-			promptForNumbers("        > Is there " + model.FullName + "? (0 or 1)        ", model.initialCount);
-			model.initialCount = model.initialCount == 0 ? 1 : 0;
+		else if (model.FullName == "UPPER" || model.FullName == "LOWER") {
+			promptForNumbers("       How many " + model.FullName + "? (Numbers)                   ", value);
 		}
-
-		if (model.FullName.find("PASSIVE") != std::string::npos) {
-			promptForNumbers("        >> Which Step " + model.FullName + "? (Numbers)     ", model.initialCount);
-			
-			if (model.initialCount == 0) model.initialCount = 1;
-			else model.count = model.initialCount;
+		else if (model.FullName.find("PASSIVE") != std::string::npos) {
+			promptForNumbers("        >> Which Step " + model.FullName + "? (Numbers)     ", value);
 		}
+		else {
+			promptForNumbers("        > Is there " + model.FullName + "? (0 or 1)        ", value);
+		}
+		applyModelAnswer(model, value);
+	}
+
+	if (args.count("-FONT") && !Glyph_Font::active().load(args["-FONT"])) return EXIT_FAILURE;
+
+	Fixture_Base_Params base;
+	if (args.count("-FB") && !base.parse(args["-FB"])) {
+		std::cerr << Red << "      Invalid fixture base size: " << ColorEnd << args["-FB"] << std::endl;
+		return EXIT_FAILURE;
+	}
+	TagLayout layout;
+	if (!base.place_tag(layout)) {
+		std::cerr << Red << "      The fixture base cannot hold the tag: " << ColorEnd << args["-FB"] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (args.count("--threads")) args["-T"] = args["--threads"];
+	if (args.count("-T")) FIXTURE_THREADS = static_cast<unsigned>(std::max(0, std::atoi(args["-T"].c_str())));
+	CANONICAL_OUTPUT = args.count("-CO") && std::atoi(args["-CO"].c_str()) != 0;
+
+	Plate_Settings plates;
+	if (args.count("-NEST") && !plates.parse(args["-NEST"])) {
+		std::cerr << Red << "      Invalid build plate: " << ColorEnd << args["-NEST"] << std::endl;
+		return EXIT_FAILURE;
 	}
 
+	// AB_FIXTURE_CACHE overrides the cache folder, AB_FIXTURE_CACHE_MB its size (0 disables it).
+	Output_Cache cache(get_env("AB_FIXTURE_CACHE", (fs::current_path() / ".fixture_cache").string()),
+		static_cast<uintmax_t>(std::max(0.0, std::atof(get_env("AB_FIXTURE_CACHE_MB", "1024").c_str())) * 1024 * 1024));
+
+	// AB_FIXTURE_STATS=<file.jsonl> records per-stage timings of every generated fixture.
+	std::string statsPath = get_env("AB_FIXTURE_STATS");
+	if (!statsPath.empty()) Stage_Stats::instance().open(statsPath);
+
 	auto start = std::chrono::high_resolution_clock::now();
 
 	std::cout << Yellow << "\n============================'Creating Fixtures'==============================\n" << ColorEnd << std::endl;
 
-	int processedCount = 0;
+	// Geometry runs on this thread while finished fixtures are written behind it.
+	std::atomic<int> processedCount{ 0 };
+	bool use3MF = args.count("-3MF") && std::atoi(args["-3MF"].c_str()) != 0;
+	std::unique_ptr<Case_Archive> archive;
+	std::unique_ptr<Plate_Nester> nester;
+	Case_Sink sink;
+	if (plates.enabled) {
+		nester = std::make_unique<Plate_Nester>(plates);
+		sink = [&nester](const std::string& id, Mesh& mesh) { return nester->add(id, std::move(mesh)); };
+	}
+	else if (use3MF) {
+		archive = std::make_unique<Case_Archive>(fs::path(outputPath) / (std::to_string(caseID) + ".3mf"), std::to_string(caseID));
+		sink = [&archive](const std::string& id, Mesh& mesh) { return archive->add(id, mesh); };
+	}
+	Output_Writer writer(2, 4);
+	int failures = 0;
 	for (const auto& model : models) {
 		for (int i = model.initialCount; i <= model.count; ++i) {
-			if (processModel(outputPath, caseID, model, i)) {
-				processedCount++;
-			}
-			else {
+			if (!processModel(outputPath, caseID, model, i, base, layout, cache, writer, sink, processedCount)) {
 				std::cerr << Red << "      Failed to process " << ColorEnd
 					<< model.FullName << " index " << i << std::endl;
+				++failures;
 			}
 		}
 	}
+	writer.flush();
+	if (archive) {
+		arrange_archive(*archive, plates);
+		if (!archive->close()) processedCount = 0;
+	}
+	if (nester) processedCount = nester->write_plates(outputPath + "/" + std::to_string(caseID), use3MF);
 	std::cout << Yellow << "\n================================='Finished'==================================" << ColorEnd << std::endl;
 	std::cout << Yellow <<   "=================================='REPORT'===================================\n" << ColorEnd << std::endl;
 
 
-	std::cout << "      " << Green << processedCount << ColorEnd 
-		<< "  Fixtures STL in 'output' " << Green << "with OCR Tag" << ColorEnd << std::endl;
+	std::cout << "      " << Green << processedCount.load() << ColorEnd 
+		<< (nester ? std::string("  Fixtures nested on build plates ") : archive ? "  Fixtures in '" + std::to_string(caseID) + ".3mf' " : std::string("  Fixtures STL in 'output' ")) << Green << "with OCR Tag" << ColorEnd << std::endl;
+	if (cache.is_enabled()) {
+		cache.evict();
+		std::cout << "      " << Green << cache.hit_count() << ColorEnd << "  from cache, "
+			<< Yellow << cache.miss_count() << ColorEnd << "  generated";
+		if (cache.evicted_count() > 0) std::cout << ", " << cache.evicted_count() << "  old entries evicted";
+		std::cout << std::endl;
+	}
+	if (writer.failed_count() > 0) {
+		std::cout << "      " << Red << writer.failed_count() << ColorEnd << "  Fixtures failed to write" << std::endl;
+	}
+	if (failures > 0) {
+		std::cout << "      " << Red << failures << ColorEnd << "  Fixtures failed to build" << std::endl;
+	}
+	if (DEBUG) std::cout << "      Waited " << writer.stalled_seconds() << " seconds on the output queue" << std::endl;
 	std::cout << std::endl;
 	displayUserName();
 
 	auto finish = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed = finish - start;
 	std::cout << Yellow << "      Elapsed time: " << elapsed.count() << " seconds" << ColorEnd << std::endl;
+	Stage_Stats::instance().summary(std::cout);
 
 	std::cout << std::endl;
 	std::cout << std::endl;
-	std::cout << "      Press " << Green << "ENTER" << ColorEnd << " key to exit . . . " << std::endl;
-	std::cin.get();
-	return EXIT_SUCCESS;
+	if (interactive) {
+		std::cout << "      Press " << Green << "ENTER" << ColorEnd << " key to exit . . . " << std::endl;
+		std::cin.get();
+	}
+	return failures == 0 && writer.failed_count() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
\ No newline at end of file
@@ -0,0 +1,400 @@
+#ifndef CASE_ARCHIVE_H
+#define CASE_ARCHIVE_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "Fixture_Common.h"
+
+#ifdef FIXTURE_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+// Whole-case export as one 3MF file instead of one STL per fixture.
+//
+// A 3MF is a zip with three parts: the content types, the package
+// relationships and 3D/3dmodel.model, the XML holding every object and the
+// build plate. The two small parts are written up front and the model part
+// is then streamed: each add() serializes its mesh on the calling thread and
+// appends the <object> under a lock, so the case is written as one file with
+// one open and one rename, and no mesh has to wait for the others. The build
+// section and the zip central directory are written by close(), so objects
+// can still be moved on the build plate (place()) until then; add() without
+// an offset leaves an object at the origin, and arrange_archive
+// (Plate_Nesting.h) lays such a case out before it is closed.
+//
+// Entries are deflated when built with FIXTURE_WITH_ZLIB (and level > 0) and
+// stored otherwise. Sizes follow each entry in a data descriptor, since the
+// model part's size is only known at the end. Archives are limited to 4 GB
+// (no zip64).
+//
+//   Case_Archive archive(outputPath / "123456.3mf", "123456");
+//   archive.add("123456UN01", Result_Mesh);   // from any thread
+//   archive.close();
+
+inline uint32_t archive_crc32(uint32_t crc, const char* data, size_t size) {
+#ifdef FIXTURE_WITH_ZLIB
+	while (size > 0) {
+		uInt chunk = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+		crc = static_cast<uint32_t>(::crc32(crc, reinterpret_cast<const Bytef*>(data), chunk));
+		data += chunk;
+		size -= chunk;
+	}
+	return crc;
+#else
+	static const std::array<uint32_t, 256> table = [] {
+		std::array<uint32_t, 256> t{};
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			t[i] = c;
+		}
+		return t;
+	}();
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+	return ~crc;
+#endif
+}
+
+// Sequential zip writer: one entry open at a time, sizes in data descriptors.
+class Zip_Writer {
+public:
+	Zip_Writer(const fs::path& path, int level) : out(path, std::ios::binary | std::ios::trunc), level(level) {
+#ifndef FIXTURE_WITH_ZLIB
+		this->level = 0;
+#endif
+	}
+
+	~Zip_Writer() {
+#ifdef FIXTURE_WITH_ZLIB
+		if (deflating) deflateEnd(&zs);
+#endif
+	}
+
+	Zip_Writer(const Zip_Writer&) = delete;
+	Zip_Writer& operator=(const Zip_Writer&) = delete;
+
+	bool good() const { return ok && out.good(); }
+
+	void begin(const std::string& name) {
+		Entry entry{ name, static_cast<uint16_t>(level > 0 ? 8 : 0), 0, 0, 0, static_cast<uint32_t>(offset) };
+		check_offset();
+		put32(0x04034b50);
+		put16(20);           // version needed
+		put16(0x0008);       // sizes in the data descriptor
+		put16(entry.method);
+		put16(0);            // 00:00:00
+		put16(0x0021);       // 1980-01-01
+		put32(0);
+		put32(0);
+		put32(0);
+		put16(static_cast<uint16_t>(name.size()));
+		put16(0);
+		put(name.data(), name.size());
+		entries.push_back(entry);
+#ifdef FIXTURE_WITH_ZLIB
+		if (entry.method == 8) {
+			zs = z_stream();
+			deflating = deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+			ok = ok && deflating;
+		}
+#endif
+	}
+
+	void append(const char* data, size_t size) {
+		Entry& entry = entries.back();
+		entry.crc = archive_crc32(entry.crc, data, size);
+		entry.usize += static_cast<uint32_t>(size);
+		if (entry.method == 0) {
+			put(data, size);
+			entry.csize += static_cast<uint32_t>(size);
+			return;
+		}
+#ifdef FIXTURE_WITH_ZLIB
+		while (size > 0) {
+			uInt chunk = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+			zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+			zs.avail_in = chunk;
+			pump(Z_NO_FLUSH);
+			data += chunk;
+			size -= chunk;
+		}
+#endif
+	}
+
+	void end() {
+		Entry& entry = entries.back();
+#ifdef FIXTURE_WITH_ZLIB
+		if (entry.method == 8) {
+			zs.avail_in = 0;
+			pump(Z_FINISH);
+			deflateEnd(&zs);
+			deflating = false;
+		}
+#endif
+		put32(0x08074b50);
+		put32(entry.crc);
+		put32(entry.csize);
+		put32(entry.usize);
+	}
+
+	// Central directory and end record; the writer is done afterwards.
+	bool finish() {
+		uint64_t directory = offset;
+		check_offset();
+		for (const Entry& entry : entries) {
+			put32(0x02014b50);
+			put16(20);       // made by
+			put16(20);       // needed
+			put16(0x0008);
+			put16(entry.method);
+			put16(0);
+			put16(0x0021);
+			put32(entry.crc);
+			put32(entry.csize);
+			put32(entry.usize);
+			put16(static_cast<uint16_t>(entry.name.size()));
+			put16(0);        // extra
+			put16(0);        // comment
+			put16(0);        // disk
+			put16(0);        // internal attributes
+			put32(0);        // external attributes
+			put32(entry.offset);
+			put(entry.name.data(), entry.name.size());
+		}
+		uint64_t directorySize = offset - directory;
+		check_offset();
+		put32(0x06054b50);
+		put16(0);
+		put16(0);
+		put16(static_cast<uint16_t>(entries.size()));
+		put16(static_cast<uint16_t>(entries.size()));
+		put32(static_cast<uint32_t>(directorySize));
+		put32(static_cast<uint32_t>(directory));
+		put16(0);
+		out.close();
+		return ok && !out.fail();
+	}
+
+	uint64_t bytes_written() const { return offset; }
+
+private:
+	struct Entry {
+		std::string name;
+		uint16_t method;
+		uint32_t crc, csize, usize, offset;
+	};
+
+	void put(const char* data, size_t size) {
+		out.write(data, static_cast<std::streamsize>(size));
+		offset += size;
+	}
+	void put16(uint16_t v) {
+		const char b[2] = { static_cast<char>(v), static_cast<char>(v >> 8) };
+		put(b, 2);
+	}
+	void put32(uint32_t v) {
+		const char b[4] = { static_cast<char>(v), static_cast<char>(v >> 8), static_cast<char>(v >> 16), static_cast<char>(v >> 24) };
+		put(b, 4);
+	}
+	void check_offset() {
+		if (offset > 0xffffffffULL) ok = false;
+	}
+
+#ifdef FIXTURE_WITH_ZLIB
+	void pump(int flush) {
+		char buffer[1 << 16];
+		int status;
+		do {
+			zs.next_out = reinterpret_cast<Bytef*>(buffer);
+			zs.avail_out = sizeof(buffer);
+			status = deflate(&zs, flush);
+			size_t produced = sizeof(buffer) - zs.avail_out;
+			put(buffer, produced);
+			entries.back().csize += static_cast<uint32_t>(produced);
+		} while (status == Z_OK && (zs.avail_out == 0 || flush == Z_FINISH));
+		if (status != Z_OK && status != Z_BUF_ERROR && status != Z_STREAM_END) ok = false;
+	}
+
+	z_stream zs = z_stream();
+	bool deflating = false;
+#endif
+
+	std::ofstream out;
+	int level;
+	uint64_t offset = 0;
+	bool ok = true;
+	std::vector<Entry> entries;
+};
+
+inline std::string xml_escape(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		switch (c) {
+		case '&': escaped += "&amp;"; break;
+		case '<': escaped += "&lt;"; break;
+		case '>': escaped += "&gt;"; break;
+		case '"': escaped += "&quot;"; break;
+		default: escaped += c;
+		}
+	}
+	return escaped;
+}
+
+class Case_Archive {
+public:
+	Case_Archive(const fs::path& path, const std::string& title, int level = 6)
+		: target(path), temp(fs::path(path) += ".tmp"), zip(temp, level) {
+		static const char contentTypes[] =
+			"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			"<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+			"<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+			"<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>"
+			"</Types>\n";
+		static const char relationships[] =
+			"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			"<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">"
+			"<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>"
+			"</Relationships>\n";
+		zip.begin("[Content_Types].xml");
+		zip.append(contentTypes, sizeof(contentTypes) - 1);
+		zip.end();
+		zip.begin("_rels/.rels");
+		zip.append(relationships, sizeof(relationships) - 1);
+		zip.end();
+
+		std::string header = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			"<model unit=\"millimeter\" xml:lang=\"en-US\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+			" <metadata name=\"Title\">" + xml_escape(title) + "</metadata>\n"
+			" <metadata name=\"Application\">AB_FIXTURE_CREATOR</metadata>\n"
+			" <resources>\n";
+		zip.begin("3D/3dmodel.model");
+		zip.append(header.data(), header.size());
+		open = zip.good();
+		if (!open) std::cerr << Red << "Error: Cannot write the 3MF file:  " << ColorEnd << target.filename() << std::endl;
+	}
+
+	~Case_Archive() {
+		if (open) close();
+	}
+
+	Case_Archive(const Case_Archive&) = delete;
+	Case_Archive& operator=(const Case_Archive&) = delete;
+
+	// Adds the mesh as one object, placed at offset on the build plate. Safe to
+	// call from several threads; the XML is built before taking the lock.
+	bool add(const std::string& name, const Mesh& mesh, const Vector& offset = Vector(0, 0, 0)) {
+		std::string xml;
+		xml.reserve(64 * mesh.number_of_vertices() + 48 * mesh.number_of_faces() + 256);
+		std::vector<uint32_t> index(mesh.num_vertices());
+		char line[160];
+		uint32_t next = 0;
+		CGAL::Bbox_2 footprint;
+		xml += "  <object id=\"#\" type=\"model\" name=\"" + xml_escape(name) + "\">\n   <mesh>\n    <vertices>\n";
+		for (Vertex_index v : mesh.vertices()) {
+			const Point& p = mesh.point(v);
+			footprint += CGAL::Bbox_2(p.x(), p.y(), p.x(), p.y());
+			std::snprintf(line, sizeof(line), "     <vertex x=\"%.10g\" y=\"%.10g\" z=\"%.10g\"/>\n", p.x(), p.y(), p.z());
+			xml += line;
+			index[v.idx()] = next++;
+		}
+		xml += "    </vertices>\n    <triangles>\n";
+		for (Face_index f : mesh.faces()) {
+			// Fan for anything that is not a triangle
+			Halfedge_index h = mesh.halfedge(f), first = h;
+			uint32_t v0 = index[mesh.target(h).idx()];
+			for (h = mesh.next(mesh.next(first)); h != first; h = mesh.next(h)) {
+				std::snprintf(line, sizeof(line), "     <triangle v1=\"%u\" v2=\"%u\" v3=\"%u\"/>\n",
+					v0, index[mesh.source(h).idx()], index[mesh.target(h).idx()]);
+				xml += line;
+			}
+		}
+		xml += "    </triangles>\n   </mesh>\n  </object>\n";
+
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!open) return false;
+		// Object ids follow the order the objects reach the archive
+		std::string id = std::to_string(items.size() + 1);
+		std::size_t mark = xml.find('#');
+		xml.replace(mark, 1, id);
+		zip.append(xml.data(), xml.size());
+		items.push_back(Item{ name, footprint, offset });
+		if (!zip.good()) {
+			std::cerr << Red << "Error: Cannot write the 3MF file:  " << ColorEnd << target.filename() << std::endl;
+			return false;
+		}
+		if (DEBUG) std::cout << Yellow << "      Added to 3MF:  " << ColorEnd << name << std::endl;
+		return true;
+	}
+
+	// Writes the build plate and the central directory and moves the file into place.
+	bool close() {
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!open) return false;
+		open = false;
+		std::string footer = " </resources>\n <build>\n";
+		char line[200];
+		for (std::size_t i = 0; i < items.size(); ++i) {
+			const Vector& t = items[i].offset;
+			std::snprintf(line, sizeof(line), "  <item objectid=\"%zu\" transform=\"1 0 0 0 1 0 0 0 1 %.10g %.10g %.10g\"/>\n",
+				i + 1, t.x(), t.y(), t.z());
+			footer += line;
+		}
+		footer += " </build>\n</model>\n";
+		zip.append(footer.data(), footer.size());
+		zip.end();
+
+		bool ok = zip.finish();
+		std::error_code ec;
+		if (ok) fs::rename(temp, target, ec);
+		if (!ok || ec) {
+			fs::remove(temp, ec);
+			std::cerr << Red << "Error: Cannot write the 3MF file:  " << ColorEnd << target.filename() << std::endl;
+			return false;
+		}
+		if (DEBUG) std::cout << Yellow << "      Wrote 3MF file:  " << ColorEnd << target.filename()
+			<< " (" << items.size() << " objects, " << zip.bytes_written() << " bytes)" << std::endl;
+		return true;
+	}
+
+	int object_count() const { return static_cast<int>(items.size()); }
+
+	// Name and XY footprint of every object, in the order they were added.
+	std::vector<std::pair<std::string, CGAL::Bbox_2>> objects() {
+		std::lock_guard<std::mutex> lock(mtx);
+		std::vector<std::pair<std::string, CGAL::Bbox_2>> list;
+		for (const Item& item : items) list.emplace_back(item.name, item.footprint);
+		return list;
+	}
+
+	// Moves object i (in the order of objects()) to offset on the build plate.
+	void place(std::size_t i, const Vector& offset) {
+		std::lock_guard<std::mutex> lock(mtx);
+		if (i < items.size()) items[i].offset = offset;
+	}
+
+private:
+	struct Item {
+		std::string name;
+		CGAL::Bbox_2 footprint;
+		Vector offset;
+	};
+
+	fs::path target, temp;
+	Zip_Writer zip;
+	std::mutex mtx;
+	std::vector<Item> items;
+	bool open = false;
+};
+
+#endif // CASE_ARCHIVE_H
@@ -0,0 +1,144 @@
+#ifndef CONCURRENCY_H
+#define CONCURRENCY_H
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "Thread_Pool.h"
+
+#include <CGAL/tags.h>
+
+#ifdef CGAL_LINKED_WITH_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#endif
+
+// One worker budget for the whole process.
+//
+// FIXTURE_THREADS (-T / --threads on the command line) bounds everything that
+// runs in parallel: batch items, boolean tiles and the CGAL algorithms that
+// take a concurrency tag. With TBB (CGAL_LINKED_WITH_TBB) all of it runs in
+// one task arena of that size, so nested loops share its workers and never
+// add threads. Without TBB it runs on one shared Thread_Pool; work started
+// from inside a pool job runs inline on that job's thread, which keeps a
+// batch of N items on N threads and cannot deadlock the pool.
+//
+//   Task_Batch batch;
+//   for (...) batch.run([=] { ... });
+//   batch.wait();
+//   parallel_for(tiles, [&](std::size_t t) { ... });
+
+// Worker count for all parallel work; 0 uses every core. Set it before the
+// first parallel call, the pool and the arena are sized then.
+inline unsigned FIXTURE_THREADS = 0;
+
+// CGAL algorithms with sequential and parallel variants get this tag: parallel
+// when CGAL was built with TBB, sequential otherwise.
+typedef CGAL::Parallel_if_available_tag Concurrency_Tag;
+
+inline unsigned fixture_threads() {
+	return FIXTURE_THREADS ? FIXTURE_THREADS : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Threads a parallel section started here may use: 1 inside a pool job.
+inline unsigned available_threads() {
+	return in_pool_task ? 1u : fixture_threads();
+}
+
+#ifdef CGAL_LINKED_WITH_TBB
+inline tbb::task_arena& fixture_arena() {
+	static tbb::task_arena arena(static_cast<int>(fixture_threads()));
+	return arena;
+}
+#else
+inline Thread_Pool& fixture_pool() {
+	static Thread_Pool pool(fixture_threads());
+	return pool;
+}
+#endif
+
+// Runs f where tagged CGAL algorithms draw their threads from: inside the
+// arena with TBB, so a Concurrency_Tag call never exceeds FIXTURE_THREADS.
+template <typename F>
+auto with_fixture_threads(F&& f) -> decltype(f()) {
+#ifdef CGAL_LINKED_WITH_TBB
+	if (!in_pool_task) return fixture_arena().execute(std::forward<F>(f));
+#endif
+	return f();
+}
+
+// A set of jobs on the shared workers that can be waited for on its own.
+// Jobs must not throw.
+class Task_Batch {
+public:
+	Task_Batch() = default;
+	~Task_Batch() { wait(); }
+
+	Task_Batch(const Task_Batch&) = delete;
+	Task_Batch& operator=(const Task_Batch&) = delete;
+
+	void run(std::function<void()> job) {
+		if (in_pool_task) {
+			job();
+			return;
+		}
+#ifdef CGAL_LINKED_WITH_TBB
+		fixture_arena().execute([&] { group.run(std::move(job)); });
+#else
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			++pending;
+		}
+		fixture_pool().enqueue([this, job = std::move(job)] {
+			job();
+			std::lock_guard<std::mutex> lock(mtx);
+			if (--pending == 0) done.notify_all();
+		});
+#endif
+	}
+
+	void wait() {
+#ifdef CGAL_LINKED_WITH_TBB
+		fixture_arena().execute([&] { group.wait(); });
+#else
+		std::unique_lock<std::mutex> lock(mtx);
+		done.wait(lock, [this] { return pending == 0; });
+#endif
+	}
+
+	unsigned size() const { return available_threads(); }
+
+private:
+#ifdef CGAL_LINKED_WITH_TBB
+	tbb::task_group group;
+#else
+	std::mutex mtx;
+	std::condition_variable done;
+	std::size_t pending = 0;
+#endif
+};
+
+// body(i) for every i in [0, n), in parallel when there is more than one thread to use.
+template <typename Body>
+void parallel_for(std::size_t n, const Body& body) {
+	if (n < 2 || available_threads() < 2) {
+		for (std::size_t i = 0; i < n; ++i) body(i);
+		return;
+	}
+#ifdef CGAL_LINKED_WITH_TBB
+	fixture_arena().execute([&] { tbb::parallel_for(std::size_t(0), n, [&](std::size_t i) { body(i); }); });
+#else
+	Task_Batch batch;
+	for (std::size_t i = 0; i < n; ++i) batch.run([&body, i] { body(i); });
+	batch.wait();
+#endif
+}
+
+#endif // CONCURRENCY_H
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "Fixture_Mesh.h"
+#include "Fixture_Base.h"
+#include "Stage_Stats.h"
+
+#include <CGAL/boost/graph/generators.h>
+#include <CGAL/subdivision_method_3.h>
+
+// Benchmarks the fixture pipelines on fixed inputs and writes one tab-separated
+// row per case. Rows come out in a fixed order and only hold measurements, so
+// two result files can be diffed directly.
+//
+//   FIXTURE_BENCH [-R repetitions] [-L max_sphere_level] [-O bench_results.tsv]
+//   FIXTURE_BENCH -CHECK 1
+//
+// Build with FIXTURE_COUNT_ALLOCATIONS to fill the allocs column. -CHECK runs
+// the fast paths against their references instead of timing them (ctest runs
+// it): every embedded glyph must have an outline, and every bench ID must
+// engrave in 2D with the volume of the 3D boolean, the tiled boolean must
+// match the serial one on every multi-glyph tag, and block bases of other
+// sizes (-FB) must either engrave the same way or be refused for not holding
+// the tag. The exit code is 1 when a check fails.
+
+struct Bench_Result {
+	std::string name, param;
+	std::vector<double> ms;
+	double work = 0.0;   // units of work per repetition
+	std::string unit;    // what "work" counts
+	long long allocations = -1; // per repetition, -1 unless built with FIXTURE_COUNT_ALLOCATIONS
+};
+
+template <typename Setup, typename Run>
+Bench_Result run_case(const std::string& name, const std::string& param, int reps, double work, const std::string& unit,
+	Setup setup, Run run) {
+	Bench_Result result{ name, param, {}, work, unit };
+	setup();
+	run(); // warm-up, also fills the glyph cache
+	long long allocations = 0;
+	for (int i = 0; i < reps; ++i) {
+		setup();
+		long long before = stage_allocations;
+		auto start = std::chrono::steady_clock::now();
+		run();
+		result.ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		allocations += stage_allocations - before;
+	}
+#ifdef FIXTURE_COUNT_ALLOCATIONS
+	result.allocations = allocations / reps;
+#endif
+	std::sort(result.ms.begin(), result.ms.end());
+
+	std::cout << "      " << std::left << std::setw(16) << name << std::setw(22) << param << std::right
+		<< std::fixed << std::setprecision(2) << " p50 " << std::setw(9) << percentile(result.ms, 0.50)
+		<< " ms   p99 " << std::setw(9) << percentile(result.ms, 0.99) << " ms" << std::defaultfloat << std::endl;
+	return result;
+}
+
+// Closed sphere of 20 * 4^level triangles.
+Mesh make_sphere(int level, const Point& center, double radius) {
+	Mesh sphere;
+	CGAL::make_icosahedron(sphere, center, radius);
+	if (level > 0) CGAL::Subdivision_method_3::Loop_subdivision(sphere, CGAL::parameters::number_of_iterations(level));
+	return sphere;
+}
+
+bool write_results(const std::string& path, const std::vector<Bench_Result>& results) {
+	std::ofstream out(path);
+	if (!out) {
+		std::cerr << Red << "Error: Cannot write the results file:  " << ColorEnd << path << std::endl;
+		return false;
+	}
+	out << "case\tparam\treps\tp50_ms\tp90_ms\tp99_ms\tmean_ms\tthroughput\tunit\tallocs\n";
+	out << std::fixed << std::setprecision(3);
+	for (const Bench_Result& r : results) {
+		double mean = std::accumulate(r.ms.begin(), r.ms.end(), 0.0) / std::max<size_t>(1, r.ms.size());
+		out << r.name << '\t' << r.param << '\t' << r.ms.size() << '\t'
+			<< percentile(r.ms, 0.50) << '\t' << percentile(r.ms, 0.90) << '\t' << percentile(r.ms, 0.99) << '\t'
+			<< mean << '\t' << (mean > 0 ? r.work * 1000.0 / mean : 0.0) << '\t' << r.unit << "/s\t" << r.allocations << '\n';
+	}
+	return true;
+}
+
+// Same volume within the tolerance create_fixture validates the engraving with.
+bool same_volume(const Mesh& a, const Mesh& b) {
+	if (!CGAL::is_closed(a) || !CGAL::is_closed(b)) return false;
+	double va = PMP::volume(a), vb = PMP::volume(b);
+	return std::abs(va - vb) <= 1e-6 * std::max(1.0, std::abs(vb));
+}
+
+int run_checks(const Mesh& Base_Fixture, const TagLayout& layout, const std::vector<std::pair<std::string, std::string>>& ids) {
+	int failed = 0;
+	auto report = [&](bool ok, const std::string& what, const std::string& detail) {
+		if (ok) std::cout << Green << "      [ OK ] " << ColorEnd;
+		else std::cout << Red << "      [FAIL] " << ColorEnd;
+		std::cout << what << "  " << detail << std::endl;
+		if (!ok) ++failed;
+	};
+
+	const std::string glyphs = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	int outlined = 0;
+	for (char c : glyphs) {
+		std::shared_ptr<const Glyph_Font::Glyph> glyph = Glyph_Font::active().glyph(c);
+		if (glyph && glyph->hasOutline) ++outlined;
+		else report(false, std::string("glyph ") + c, "has no outline, it always takes the 3D boolean");
+	}
+	report(outlined == static_cast<int>(glyphs.size()), "glyph outlines",
+		std::to_string(outlined) + " of " + std::to_string(glyphs.size()));
+
+	long long engraved = 0, fallbacks = 0;
+	for (const auto& id : ids) {
+		Mesh Engraved_Mesh, Reference_Mesh;
+		long long before = engraved_fixtures;
+		ENGRAVE_2D = true;
+		bool built = create_fixture(id.second, Base_Fixture, Engraved_Mesh, layout);
+		bool planar = engraved_fixtures > before;
+		ENGRAVE_2D = false;
+		built = create_fixture(id.second, Base_Fixture, Reference_Mesh, layout) && built;
+		ENGRAVE_2D = true;
+		if (planar) ++engraved;
+		else ++fallbacks;
+		report(built && planar && same_volume(Engraved_Mesh, Reference_Mesh), "engrave " + id.second,
+			!built ? "not built" : !planar ? "fell back to the 3D boolean" : "volume " + std::to_string(PMP::volume(Engraved_Mesh))
+			+ " vs " + std::to_string(PMP::volume(Reference_Mesh)));
+	}
+	// The tiled boolean against the serial one on the same tag, with tiles forced
+	// whatever the core count
+	for (const auto& id : ids) {
+		if (id.second.size() < 2) continue;
+		std::vector<Glyph_Placement> placements;
+		TagLayout placed;
+		Mesh Tag_Mesh;
+		if (!layout_tag(id.second, layout, placements, placed) || !assemble_tag_mesh(placements, placed, Tag_Mesh)) continue;
+		Mesh tiledTarget = Base_Fixture, tiledTool = Tag_Mesh, Tiled_Mesh;
+		Mesh serialTarget = Base_Fixture, serialTool = Tag_Mesh, Serial_Mesh;
+		bool tiled = tiled_boolean(tiledTarget, tiledTool, Tiled_Mesh, Boolean_Op::Difference, 4);
+		bool serial = serial_boolean(serialTarget, serialTool, Serial_Mesh, Boolean_Op::Difference);
+		report(tiled && serial && same_volume(Tiled_Mesh, Serial_Mesh), "tiled " + id.second,
+			!tiled ? "fell back to the serial boolean" : !serial ? "serial boolean failed" : "volume " + std::to_string(PMP::volume(Tiled_Mesh))
+			+ " vs " + std::to_string(PMP::volume(Serial_Mesh)));
+	}
+
+	// Block bases of other sizes: the tag must sink from their top, not float
+	// above it or sit sealed inside, and blocks too small for it are refused
+	const std::vector<std::pair<std::string, bool>> blocks = {
+		{ "40,40,2", true }, { "40,40,8", true }, { "50,45,6", true }, { "20,20,4", false }, { "40,40,0.9", false },
+	};
+	for (const auto& block : blocks) {
+		Fixture_Base_Params blockParams;
+		TagLayout blockLayout = layout;
+		Mesh Block_Fixture, Engraved_Mesh, Reference_Mesh;
+		bool placed = blockParams.parse(block.first) && blockParams.place_tag(blockLayout);
+		if (!block.second || !placed) {
+			report(placed == block.second, "block " + block.first, placed ? "accepted a base that cannot hold the tag" : "refused");
+			continue;
+		}
+		if (!load_fixture_base(blockParams, Block_Fixture)) {
+			report(false, "block " + block.first, "base not built");
+			continue;
+		}
+		long long before = engraved_fixtures;
+		bool built = create_fixture(ids[1].second, Block_Fixture, Engraved_Mesh, blockLayout);
+		bool planar = engraved_fixtures > before;
+		ENGRAVE_2D = false;
+		built = create_fixture(ids[1].second, Block_Fixture, Reference_Mesh, blockLayout) && built;
+		ENGRAVE_2D = true;
+		bool cut = built && PMP::volume(Engraved_Mesh) < PMP::volume(Block_Fixture) - 1e-3;
+		report(built && planar && cut && same_volume(Engraved_Mesh, Reference_Mesh), "block " + block.first,
+			!built ? "not built" : !planar ? "the tag does not cross the top" : !cut ? "the tag cuts nothing"
+			: "volume " + std::to_string(PMP::volume(Engraved_Mesh)) + " vs " + std::to_string(PMP::volume(Reference_Mesh)));
+	}
+
+	std::cout << "\n      " << engraved << " engraved in 2D, ";
+	if (fallbacks) std::cout << Red;
+	std::cout << fallbacks << ColorEnd << " fell back, ";
+	if (failed) std::cout << Red;
+	std::cout << failed << ColorEnd << " failed" << std::endl;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+	std::map<std::string, std::string> args;
+	for (int i = 1; i + 1 < argc; i += 2) args[argv[i]] = argv[i + 1];
+	int reps = args.count("-R") ? std::max(1, std::atoi(args["-R"].c_str())) : 5;
+	int maxLevel = args.count("-L") ? std::max(1, std::atoi(args["-L"].c_str())) : 5;
+	std::string outputPath = args.count("-O") ? args["-O"] : "bench_results.tsv";
+
+	std::cout << Yellow << "\n=============================='FIXTURE BENCH'================================\n" << ColorEnd << std::endl;
+
+	Mesh Base_Fixture;
+	if (!read_STL_cached("fixture", Base_Fixture)) return EXIT_FAILURE;
+
+	// create_fixture over representative ID shapes
+	const std::vector<std::pair<std::string, std::string>> ids = {
+		{ "short", "7" },
+		{ "case", "123456UN01" },
+		{ "long", "123456789012LP40" },
+		{ "mixed", "A1B2C3D4E5" },
+		{ "alpha", "ABCDEFGHIJ" },
+	};
+	// Long IDs are fitted to the tag plate, not rejected
+	TagLayout layout;
+	layout.fitToPlate = true;
+	if (args.count("-CHECK")) return run_checks(Base_Fixture, layout, ids);
+
+	std::vector<Bench_Result> results;
+	for (const auto& id : ids) {
+		Mesh Result_Mesh;
+		results.push_back(run_case("create_fixture", id.first + ":" + id.second, reps, 1.0, "fixtures",
+			[&] { Result_Mesh.clear(); },
+			[&] { create_fixture(id.second, Base_Fixture, Result_Mesh, layout); }));
+	}
+
+	// 3D corefinement on the same IDs, for comparison with the planar engraving
+	ENGRAVE_2D = false;
+	for (const auto& id : ids) {
+		Mesh Result_Mesh;
+		results.push_back(run_case("fixture_3d", id.first + ":" + id.second, reps, 1.0, "fixtures",
+			[&] { Result_Mesh.clear(); },
+			[&] { create_fixture(id.second, Base_Fixture, Result_Mesh, layout); }));
+	}
+
+	// Serial boolean on the same IDs, for comparison with the tiled one above
+	for (const auto& id : ids) {
+		Mesh Result_Mesh;
+		FIXTURE_THREADS = 1;
+		results.push_back(run_case("fixture_serial", id.first + ":" + id.second, reps, 1.0, "fixtures",
+			[&] { Result_Mesh.clear(); },
+			[&] { create_fixture(id.second, Base_Fixture, Result_Mesh, layout); }));
+		FIXTURE_THREADS = 0;
+	}
+	ENGRAVE_2D = true;
+
+	// The same IDs on the procedural block base
+	Fixture_Base_Params blockParams;
+	blockParams.parametric = true;
+	TagLayout blockLayout = layout;
+	Mesh Block_Fixture;
+	if (!blockParams.place_tag(blockLayout) || !load_fixture_base(blockParams, Block_Fixture)) return EXIT_FAILURE;
+	for (const auto& id : ids) {
+		Mesh Result_Mesh;
+		results.push_back(run_case("fixture_block", id.first + ":" + id.second, reps, 1.0, "fixtures",
+			[&] { Result_Mesh.clear(); },
+			[&] { create_fixture(id.second, Block_Fixture, Result_Mesh, blockLayout); }));
+	}
+
+	Mesh Fixture_Tag_Mesh;
+	create_fixture("123456UN01", Base_Fixture, Fixture_Tag_Mesh, layout);
+
+	for (int level = 2; level <= maxLevel; ++level) {
+		const Mesh sphere = make_sphere(level, Point(0, 6, 10), 12.0);
+		const double triangles = static_cast<double>(sphere.number_of_faces());
+		const std::string param = "triangles:" + std::to_string(sphere.number_of_faces());
+		Mesh work, other, result;
+
+		results.push_back(run_case("cut_mesh", param, reps, triangles, "triangles",
+			[&] { work = sphere; },
+			[&] { cut_mesh(work, 10.0, 0.0); }));
+
+		results.push_back(run_case("union", param, reps, triangles, "triangles",
+			[&] { work = sphere; other = Fixture_Tag_Mesh; },
+			[&] { merge_model(work, other, result); }));
+
+		const double vertices = static_cast<double>(sphere.number_of_vertices());
+		const Scale_Profile banded = Scale_Profile::threshold(0.18, 0.15, 0.30, 10.0);
+		Scale_Profile tapered = Scale_Profile::taper(-2.0, 1.0, 22.0, 0.8);
+		tapered.knotZ.insert(tapered.knotZ.begin() + 1, { 6.0, 14.0 });
+		tapered.knotScale.insert(tapered.knotScale.begin() + 1, { 0.95, 0.9 });
+
+		results.push_back(run_case("scale_banded", param, reps, vertices, "vertices",
+			[&] { work = sphere; },
+			[&] { scaleMesh(work, banded); }));
+
+		results.push_back(run_case("scale_taper", param, reps, vertices, "vertices",
+			[&] { work = sphere; },
+			[&] { scaleMesh(work, tapered); }));
+
+		std::string buffer;
+		write_STL_buffer(sphere, buffer);
+		const double megabytes = buffer.size() / (1024.0 * 1024.0);
+
+		results.push_back(run_case("stl_write", param, reps, megabytes, "MB",
+			[&] { buffer.clear(); },
+			[&] { write_STL_buffer(sphere, buffer); }));
+
+		results.push_back(run_case("stl_read", param, reps, megabytes, "MB",
+			[&] { work.clear(); },
+			[&] {
+				std::istringstream iss(buffer, std::ios::binary);
+				CGAL::IO::read_STL(iss, work);
+			}));
+	}
+
+	if (!write_results(outputPath, results)) return EXIT_FAILURE;
+	std::cout << Green << "\n      Results written to " << ColorEnd << outputPath << std::endl;
+	return EXIT_SUCCESS;
+}
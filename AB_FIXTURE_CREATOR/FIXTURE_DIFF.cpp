@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "Fixture_Mesh.h"
+#include "Concurrency.h"
+#include "Output_Cache.h"
+
+#include <CGAL/Polygon_mesh_processing/connected_components.h>
+#include <CGAL/Polygon_mesh_processing/distance.h>
+#include <CGAL/Polygon_mesh_processing/measure.h>
+
+// Geometric comparison of fixture outputs, for checking that a change to the
+// pipeline keeps the geometry. Compares two STL files, or every STL of the
+// reference folder with the file of the same name in the candidate folder.
+//
+//   FIXTURE_DIFF reference.stl|dir candidate.stl|dir [-HD max_mm] [-VR max_ratio] [-SD samples_per_mm2] [-T threads]
+//
+// Files with the same bytes (as written with -CO 1 by the same geometry) are
+// equal without loading them. Otherwise both meshes are loaded and compared by
+// topology counts, volume and the symmetric Hausdorff distance of points
+// sampled on each surface to the other (AABB tree queries). One line per pair
+// comes out in name order; the exit code is 0 when all pairs match, 1 when
+// any differs and 2 when a file is missing or unreadable.
+
+struct Mesh_Summary {
+	std::size_t vertices = 0, edges = 0, faces = 0, components = 0, borderEdges = 0;
+	bool closed = false;
+	double volume = 0.0; // 0 when the mesh is open
+};
+
+struct Diff_Settings {
+	double maxHausdorff = 1e-3;   // mm
+	double maxVolumeRatio = 1e-6; // relative to the reference volume
+	double sampleDensity = 1.0;   // points per mm^2
+};
+
+struct Diff_Result {
+	std::string name;
+	bool loaded = false, identical = false, equal = false;
+	Mesh_Summary reference, candidate;
+	double hausdorff = 0.0;
+	std::string note;
+};
+
+bool file_hash(const fs::path& path, uint64_t& hash) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) return false;
+	std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	hash = 0xcbf29ce484222325ULL;
+	fnv1a(hash, bytes.data(), bytes.size());
+	return true;
+}
+
+Mesh_Summary summarize(Mesh& mesh) {
+	Mesh_Summary summary;
+	summary.vertices = mesh.number_of_vertices();
+	summary.edges = mesh.number_of_edges();
+	summary.faces = mesh.number_of_faces();
+	auto components = mesh.add_property_map<Face_index, std::size_t>("f:diff_component", 0).first;
+	summary.components = PMP::connected_components(mesh, components);
+	mesh.remove_property_map(components);
+	for (Mesh::Edge_index e : mesh.edges()) {
+		if (mesh.is_border(e)) ++summary.borderEdges;
+	}
+	summary.closed = summary.borderEdges == 0 && CGAL::is_triangle_mesh(mesh);
+	if (summary.closed) summary.volume = PMP::volume(mesh);
+	return summary;
+}
+
+Diff_Result compare_files(const std::string& name, const fs::path& referencePath, const fs::path& candidatePath, const Diff_Settings& settings) {
+	Diff_Result result;
+	result.name = name;
+	uint64_t referenceHash, candidateHash;
+	if (!file_hash(referencePath, referenceHash) || !file_hash(candidatePath, candidateHash)) {
+		result.note = "missing file";
+		return result;
+	}
+	if (referenceHash == candidateHash) {
+		result.loaded = result.identical = result.equal = true;
+		return result;
+	}
+
+	Mesh Reference_Mesh, Candidate_Mesh;
+	if (!read_STL(referencePath.string(), Reference_Mesh) || !read_STL(candidatePath.string(), Candidate_Mesh)) {
+		result.note = "unreadable file";
+		return result;
+	}
+	result.loaded = true;
+	result.reference = summarize(Reference_Mesh);
+	result.candidate = summarize(Candidate_Mesh);
+	result.hausdorff = with_fixture_threads([&] {
+		return PMP::approximate_symmetric_Hausdorff_distance<Concurrency_Tag>(Reference_Mesh, Candidate_Mesh,
+			CGAL::parameters::number_of_points_per_area_unit(settings.sampleDensity),
+			CGAL::parameters::number_of_points_per_area_unit(settings.sampleDensity));
+	});
+
+	const Mesh_Summary& a = result.reference;
+	const Mesh_Summary& b = result.candidate;
+	std::ostringstream note;
+	if (a.components != b.components || a.closed != b.closed) note << "topology ";
+	if (std::abs(a.volume - b.volume) > settings.maxVolumeRatio * std::max(1.0, std::abs(a.volume))) note << "volume ";
+	if (result.hausdorff > settings.maxHausdorff) note << "distance ";
+	result.note = note.str();
+	result.equal = result.note.empty();
+	return result;
+}
+
+void print_result(const Diff_Result& r) {
+	if (r.identical) {
+		std::cout << Green << "      [SAME] " << ColorEnd << r.name << "  identical bytes" << std::endl;
+		return;
+	}
+	if (!r.loaded) {
+		std::cout << Red << "      [FAIL] " << ColorEnd << r.name << "  " << r.note << std::endl;
+		return;
+	}
+	if (r.equal) std::cout << Green << "      [ OK ] " << ColorEnd;
+	else std::cout << Red << "      [DIFF] " << ColorEnd;
+	std::cout << r.name
+		<< std::setprecision(6) << "  hausdorff " << r.hausdorff << " mm"
+		<< ", volume " << r.reference.volume << " / " << r.candidate.volume
+		<< ", components " << r.reference.components << " / " << r.candidate.components
+		<< ", V/E/F " << r.reference.vertices << "/" << r.reference.edges << "/" << r.reference.faces
+		<< " vs " << r.candidate.vertices << "/" << r.candidate.edges << "/" << r.candidate.faces;
+	if (r.reference.borderEdges || r.candidate.borderEdges) {
+		std::cout << ", border edges " << r.reference.borderEdges << " / " << r.candidate.borderEdges;
+	}
+	if (!r.equal) std::cout << Red << "  (" << r.note.substr(0, r.note.size() - 1) << ")" << ColorEnd;
+	std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<std::string> paths;
+	std::map<std::string, std::string> args;
+	for (int i = 1; i < argc; ++i) {
+		if (argv[i][0] == '-' && i + 1 < argc) {
+			args[argv[i]] = argv[i + 1];
+			++i;
+		}
+		else {
+			paths.push_back(argv[i]);
+		}
+	}
+	if (paths.size() != 2) {
+		std::cerr << Yellow << "Usage: FIXTURE_DIFF reference.stl|dir candidate.stl|dir [-HD max_mm] [-VR max_ratio] [-SD samples_per_mm2] [-T threads]" << ColorEnd << std::endl;
+		return 2;
+	}
+	Diff_Settings settings;
+	if (args.count("-HD")) settings.maxHausdorff = std::atof(args["-HD"].c_str());
+	if (args.count("-VR")) settings.maxVolumeRatio = std::atof(args["-VR"].c_str());
+	if (args.count("-SD")) settings.sampleDensity = std::max(1e-3, std::atof(args["-SD"].c_str()));
+	if (args.count("--threads")) args["-T"] = args["--threads"];
+	if (args.count("-T")) FIXTURE_THREADS = static_cast<unsigned>(std::max(0, std::atoi(args["-T"].c_str())));
+
+	// Pairs by file name, in name order
+	fs::path reference(paths[0]), candidate(paths[1]);
+	std::vector<std::string> names;
+	if (fs::is_directory(reference)) {
+		for (const auto& entry : fs::directory_iterator(reference)) {
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+			if (entry.is_regular_file() && extension == ".stl") names.push_back(entry.path().filename().string());
+		}
+		std::sort(names.begin(), names.end());
+	}
+	else {
+		names.push_back(reference.filename().string());
+	}
+
+	std::vector<Diff_Result> results(names.size());
+	parallel_for(names.size(), [&](std::size_t i) {
+		bool folders = fs::is_directory(reference);
+		results[i] = compare_files(names[i], folders ? reference / names[i] : reference,
+			folders ? candidate / names[i] : candidate, settings);
+	});
+
+	int same = 0, differ = 0, failed = 0;
+	for (const Diff_Result& r : results) {
+		print_result(r);
+		if (!r.loaded) ++failed;
+		else if (r.equal) ++same;
+		else ++differ;
+	}
+	std::cout << "\n      " << Green << same << ColorEnd << " equal, ";
+	if (differ) std::cout << Red;
+	std::cout << differ << ColorEnd << " different, ";
+	if (failed) std::cout << Red;
+	std::cout << failed << ColorEnd << " missing" << std::endl;
+	return failed ? 2 : differ ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+#ifndef FIXTURE_BASE_H
+#define FIXTURE_BASE_H
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "Fixture_Mesh.h"
+
+// Top of the tag plate of fixture.stl, the height TagLayout's offsetZ is set for.
+constexpr double FIXTURE_PLATE_Z = 4.05;
+
+// Parametric fixture base: a rectangular block built directly as a closed
+// Mesh, used instead of the embedded fixture.stl when dimensions are given.
+//
+// The top face is a tensor grid whose lines are spaced tagCell apart across
+// the tag area and only at the block outline elsewhere, so the glyph boolean
+// meets small triangles where it cuts and a handful of long strips beyond it.
+// The sides follow the top outline and the bottom is a fan around its centre.
+// All measurements are in mm; the tag area defaults to the TagLayout plate,
+// which stays where fixture.stl has it while the block is resized around it.
+struct Fixture_Base_Params {
+	bool parametric = false; // false keeps the embedded fixture.stl
+	double width = 41.6, length = 41.6, height = 4.05;
+	double centerX = 0.0, centerY = 3.0;
+	double tagMinX = -13.5, tagMaxX = 13.5, tagMinY = -16.0, tagMaxY = -4.2;
+	double tagCell = 0.5;
+
+	// Parses "W,L,H"; false leaves the params untouched.
+	bool parse(const std::string& text) {
+		double w, l, h;
+		if (std::sscanf(text.c_str(), "%lf,%lf,%lf", &w, &l, &h) != 3 || w <= 0 || l <= 0 || h <= 0) return false;
+		width = w;
+		length = l;
+		height = h;
+		parametric = true;
+		return true;
+	}
+
+	// Puts the tag plate of layout on this block: the glyphs sink from the top
+	// at height as deep as they do into fixture.stl, and the plate is the
+	// refined tag area. False, leaving layout untouched, when the tag area is
+	// not 1 mm inside the block outline or the pocket floor would come closer
+	// than 0.5 mm to the bottom. The embedded fixture keeps layout as it is.
+	bool place_tag(TagLayout& layout) const {
+		if (!parametric) return true;
+		double x0 = centerX - width / 2.0, x1 = centerX + width / 2.0;
+		double y0 = centerY - length / 2.0, y1 = centerY + length / 2.0;
+		double offsetZ = height - (FIXTURE_PLATE_Z - TagLayout().offsetZ);
+		if (tagMinX < x0 + 1.0 || tagMaxX > x1 - 1.0 || tagMinY < y0 + 1.0 || tagMaxY > y1 - 1.0) return false;
+		if (offsetZ + layout.zDepth < 0.5) return false;
+		layout.offsetZ = offsetZ;
+		layout.plateMinX = tagMinX;
+		layout.plateMaxX = tagMaxX;
+		layout.plateMinY = tagMinY;
+		layout.plateMaxY = tagMaxY;
+		return true;
+	}
+};
+
+// Grid coordinates on [lo, hi]: both ends plus steps of cell through [tagLo, tagHi].
+inline std::vector<double> fixture_grid_lines(double lo, double hi, double tagLo, double tagHi, double cell) {
+	std::vector<double> lines = { lo, hi };
+	tagLo = std::max(tagLo, lo);
+	tagHi = std::min(tagHi, hi);
+	if (tagLo < tagHi && cell > 0) {
+		int steps = std::max(1, static_cast<int>(std::ceil((tagHi - tagLo) / cell)));
+		for (int i = 0; i <= steps; ++i) lines.push_back(tagLo + (tagHi - tagLo) * i / steps);
+	}
+	std::sort(lines.begin(), lines.end());
+	lines.erase(std::unique(lines.begin(), lines.end(), [](double a, double b) { return b - a < 1e-9; }), lines.end());
+	return lines;
+}
+
+inline bool make_fixture_base(const Fixture_Base_Params& params, Mesh& mesh) {
+	mesh.clear();
+	double x0 = params.centerX - params.width / 2.0, x1 = params.centerX + params.width / 2.0;
+	double y0 = params.centerY - params.length / 2.0, y1 = params.centerY + params.length / 2.0;
+	std::vector<double> xs = fixture_grid_lines(x0, x1, params.tagMinX, params.tagMaxX, params.tagCell);
+	std::vector<double> ys = fixture_grid_lines(y0, y1, params.tagMinY, params.tagMaxY, params.tagCell);
+	std::size_t nx = xs.size(), ny = ys.size();
+	mesh.reserve(static_cast<Mesh::size_type>(nx * ny + 2 * (nx + ny)),
+		static_cast<Mesh::size_type>(3 * nx * ny + 8 * (nx + ny)),
+		static_cast<Mesh::size_type>(2 * nx * ny + 6 * (nx + ny)));
+
+	// Top grid, row by row
+	std::vector<Vertex_index> top(nx * ny);
+	for (std::size_t j = 0; j < ny; ++j) {
+		for (std::size_t i = 0; i < nx; ++i) top[j * nx + i] = mesh.add_vertex(Point(xs[i], ys[j], params.height));
+	}
+	for (std::size_t j = 0; j + 1 < ny; ++j) {
+		for (std::size_t i = 0; i + 1 < nx; ++i) {
+			Vertex_index a = top[j * nx + i], b = top[j * nx + i + 1], c = top[(j + 1) * nx + i + 1], d = top[(j + 1) * nx + i];
+			mesh.add_face(a, b, c);
+			mesh.add_face(a, c, d);
+		}
+	}
+
+	// Top outline counter-clockwise seen from above, with a bottom twin per vertex
+	std::vector<Vertex_index> ring;
+	for (std::size_t i = 0; i + 1 < nx; ++i) ring.push_back(top[i]);
+	for (std::size_t j = 0; j + 1 < ny; ++j) ring.push_back(top[j * nx + nx - 1]);
+	for (std::size_t i = nx - 1; i > 0; --i) ring.push_back(top[(ny - 1) * nx + i]);
+	for (std::size_t j = ny - 1; j > 0; --j) ring.push_back(top[j * nx]);
+
+	std::vector<Vertex_index> bottom;
+	bottom.reserve(ring.size());
+	for (Vertex_index v : ring) {
+		const Point& p = mesh.point(v);
+		bottom.push_back(mesh.add_vertex(Point(p.x(), p.y(), 0.0)));
+	}
+	Vertex_index center = mesh.add_vertex(Point(params.centerX, params.centerY, 0.0));
+
+	for (std::size_t k = 0; k < ring.size(); ++k) {
+		std::size_t next = (k + 1) % ring.size();
+		mesh.add_face(bottom[k], bottom[next], ring[next]);
+		mesh.add_face(bottom[k], ring[next], ring[k]);
+		mesh.add_face(center, bottom[next], bottom[k]);
+	}
+
+	if (DEBUG) std::cout << Yellow << "      Fixture base:  " << ColorEnd << params.width << " x " << params.length << " x " << params.height
+		<< " mm, " << mesh.number_of_faces() << " faces" << std::endl;
+	return CGAL::is_closed(mesh);
+}
+
+// The fixture every tool starts from: built from params when they are
+// parametric, decoded from the embedded STL otherwise.
+inline bool load_fixture_base(const Fixture_Base_Params& params, Mesh& mesh) {
+	if (!params.parametric) return read_STL_cached("fixture", mesh);
+	if (make_fixture_base(params, mesh)) return true;
+	std::cerr << Red << "Error: Cannot build the fixture base:  " << ColorEnd
+		<< params.width << " x " << params.length << " x " << params.height << std::endl;
+	return false;
+}
+
+#endif // FIXTURE_BASE_H
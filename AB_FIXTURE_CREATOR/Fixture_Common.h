@@ -0,0 +1,58 @@
+#ifndef FIXTURE_COMMON_H
+#define FIXTURE_COMMON_H
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "rang.hpp"
+
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/Surface_mesh.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//<< Red << << ColorEnd <<
+inline auto ColorEnd = [](std::ostream& os) -> std::ostream& { return os << rang::fg::reset; };
+inline auto Red = [](std::ostream& os) -> std::ostream& { return os << rang::fg::red; };
+inline auto Green = [](std::ostream& os) -> std::ostream& { return os << rang::fg::green; };
+inline auto Yellow = [](std::ostream& os) -> std::ostream& { return os << rang::fg::yellow; };
+inline auto Blue = [](std::ostream& os) -> std::ostream& { return os << rang::fg::blue; };
+inline auto Magenta = [](std::ostream& os) -> std::ostream& { return os << rang::fg::magenta; };
+inline auto Cyan = [](std::ostream& os) -> std::ostream& { return os << rang::fg::cyan; };
+inline auto Gray = [](std::ostream& os) -> std::ostream& { return os << rang::fg::gray; };
+
+
+namespace PMP = CGAL::Polygon_mesh_processing;
+namespace fs = std::filesystem;
+inline bool DEBUG = false;
+
+typedef CGAL::Exact_predicates_inexact_constructions_kernel Kernel;
+typedef CGAL::Surface_mesh<Kernel::Point_3> Mesh;
+typedef Kernel::Point_3 Point;
+typedef Kernel::Vector_3 Vector;
+typedef Mesh::Vertex_index Vertex_index;
+typedef Mesh::Halfedge_index Halfedge_index;
+typedef Mesh::Face_index Face_index;
+typedef boost::graph_traits<Mesh>::face_descriptor face_descriptor;
+
+// Returns the environment variable, or fallback when it is not set.
+inline std::string get_env(const char* name, const std::string& fallback = "") {
+#ifdef _WIN32
+	char* value = nullptr;
+	size_t size = 0;
+	if (_dupenv_s(&value, &size, name) != 0 || value == nullptr) return fallback;
+	std::string result(value);
+	free(value);
+	return result;
+#else
+	const char* value = std::getenv(name);
+	return value ? std::string(value) : fallback;
+#endif
+}
+
+#endif // FIXTURE_COMMON_H
@@ -0,0 +1,529 @@
+#ifndef FIXTURE_MESH_H
+#define FIXTURE_MESH_H
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "Glyph_Font.h"
+#include "Mesh_Compaction.h"
+#include "OCR_font_STL.h"
+#include "Parallel_Boolean.h"
+#include "Point_SoA.h"
+#include "Stage_Stats.h"
+#include "Tag_Engraving.h"
+
+#include <CGAL/Polygon_mesh_processing/IO/polygon_mesh_io.h>
+#include <CGAL/Polygon_mesh_processing/corefinement.h>
+#include <CGAL/Polygon_mesh_processing/measure.h>
+#include <CGAL/Polygon_mesh_processing/self_intersections.h>
+
+// Placement of the engraved ID on the fixture tag plate.
+struct TagLayout {
+	double offsetX = -6.5, offsetY = -7.5, offsetZ = 4.0;
+	double XYscale = 0.18, XYtopscale = 0.18, Zscale = 0.30;
+	double zThreshold = 0.1;
+	double Xspacing = 0.8, Yspacing = 2.9;
+	double lineStartX = -6.35; // 0.15
+	double zDepth = -0.7;
+
+	// Usable area of the tag plate, for centering and fit-to-plate: the flat top
+	// of fixture.stl at z 4.05 below the model opening (x -14.5..14.5,
+	// y -17.0..-3.2), less 1 mm all round for its rounded corners.
+	double plateMinX = -13.5, plateMaxX = 13.5, plateMinY = -16.0, plateMaxY = -4.2;
+	bool center = false;     // center every line and the whole block on the plate
+	bool fitToPlate = false; // add lines and shrink glyphs and spacing until the text fits
+	double minScale = 0.75;  // smallest size fitToPlate may go to, a fraction of XYscale
+	int maxLines = 3;        // lines fitToPlate may split the text into
+
+	// How glyph points are scaled; the two-band threshold profile by default.
+	Scale_Profile profile() const { return Scale_Profile::threshold(XYscale, XYtopscale, Zscale, zThreshold); }
+};
+
+inline void get_dimensions(const Mesh& mesh, double& modelWidth, double& modelLength, double& modelHeight) {
+	double inf = std::numeric_limits<double>::infinity();
+	double xmin = inf, ymin = inf, zmin = inf, xmax = -inf, ymax = -inf, zmax = -inf;
+	for (auto v : mesh.vertices()) {
+		const Point& p = mesh.point(v);
+		xmin = std::min(xmin, p.x()); xmax = std::max(xmax, p.x());
+		ymin = std::min(ymin, p.y()); ymax = std::max(ymax, p.y());
+		zmin = std::min(zmin, p.z()); zmax = std::max(zmax, p.z());
+	}
+	if (mesh.is_empty()) xmin = xmax = ymin = ymax = zmin = zmax = 0.0;
+	modelWidth = xmax - xmin;
+	modelLength = ymax - ymin;
+	modelHeight = zmax - zmin;
+	if (DEBUG) std::cout << Yellow << "      Dimensions:" << ColorEnd
+		<< "  (W"
+		<< modelWidth << "  L"
+		<< modelLength << "  H"
+		<< modelHeight << ")" << std::endl;
+}
+
+// False, leaving mesh untouched, when the profile's knots are invalid.
+inline bool scaleMesh(Mesh& mesh, const Scale_Profile& profile) {
+	Stage_Timer timer("scale", &mesh);
+	if (!profile.valid()) {
+		std::cerr << Red << "      Error: The scale profile has invalid knots." << ColorEnd << std::endl;
+		return false;
+	}
+	for (Vertex_index v : mesh.vertices()) {
+		const Point& p = mesh.point(v);
+		double s = profile.xy_scale(p.z());
+		mesh.point(v) = Point(p.x() * s, p.y() * s, p.z() * profile.Zscale);
+	}
+	return true;
+}
+
+inline bool scaleMesh(Mesh& mesh, double XYscale, double XYtopscale, double Zscale, double zThreshold) {
+	return scaleMesh(mesh, Scale_Profile::threshold(XYscale, XYtopscale, Zscale, zThreshold));
+}
+
+inline void translate_mesh(Mesh& mesh, const Vector& translation_vector) {
+	if (DEBUG) std::cout << Yellow << "      Applying translation:  " << ColorEnd << translation_vector << std::endl;
+	for (Vertex_index v : mesh.vertices()) mesh.point(v) = mesh.point(v) + translation_vector;
+}
+
+inline bool write_STL(const std::string& filename, const Mesh& mesh) {
+	Stage_Timer timer("write", &mesh);
+	fs::path filepath(filename);
+	if (DEBUG) std::cout << Yellow << "      Writting STL file:  " << ColorEnd << filepath.filename() << std::endl;
+	if (!CGAL::IO::write_polygon_mesh(filename, mesh, CGAL::parameters::stream_precision(10))) {
+		std::cerr << Red << "Error: Cannot write the STL file:  " << ColorEnd << filepath.filename() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Serializes the mesh into the same STL bytes write_STL puts on disk.
+inline bool write_STL_buffer(const Mesh& mesh, std::string& buffer) {
+	std::ostringstream os(std::ios::binary);
+	if (!CGAL::IO::write_STL(os, mesh, CGAL::parameters::stream_precision(10))) {
+		std::cerr << Red << "Error: Cannot serialize the STL data." << ColorEnd << std::endl;
+		return false;
+	}
+	buffer = os.str();
+	return true;
+}
+
+inline bool read_STL_data(const std::string& identifier, Mesh& mesh) {
+	mesh.clear();
+	if (const STLData* data = find_STL_data(identifier.c_str())) {
+		if (DEBUG) std::cout << Yellow << "      Reading STL Data:  " << ColorEnd << identifier << std::endl;
+		std::istringstream iss(std::string(reinterpret_cast<const char*>(data->data), data->size), std::ios::binary);
+		if (CGAL::IO::read_STL(iss, mesh)) { // Ensure this matches the actual function available in CGAL
+			return true;
+		}
+	}
+	std::cerr << Red << "      Error: No STL data available for:  " << ColorEnd << identifier << std::endl;
+	return false;
+}
+
+inline bool read_STL(const std::string& filename, Mesh& mesh) {
+	mesh.clear();
+	fs::path filepath(filename);
+	if (DEBUG) std::cout << Yellow << "      Reading STL file:  " << ColorEnd << filepath.filename() << std::endl;
+	if (!PMP::IO::read_polygon_mesh(filename, mesh)) {
+		std::cerr << Red << "Error: Cannot read the STL file:  " << ColorEnd << filepath.filename() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Decodes every identifier once per process and shares the mesh between all
+// worker threads. Returns null when there is no such STL data.
+inline std::shared_ptr<const Mesh> read_STL_shared(const std::string& identifier) {
+	static std::mutex cacheMutex;
+	static std::map<std::string, std::shared_ptr<const Mesh>> cache;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		auto it = cache.find(identifier);
+		if (it != cache.end()) return it->second;
+	}
+	auto decoded = std::make_shared<Mesh>();
+	if (!read_STL_data(identifier, *decoded)) return nullptr;
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	return cache.emplace(identifier, std::move(decoded)).first->second;
+}
+
+// Same as read_STL_data, but later calls copy the mesh decoded by the first one.
+inline bool read_STL_cached(const std::string& identifier, Mesh& mesh) {
+	std::shared_ptr<const Mesh> cached = read_STL_shared(identifier);
+	if (!cached) {
+		mesh.clear();
+		return false;
+	}
+	mesh = *cached;
+	return true;
+}
+
+// Where one glyph of the ID goes on the tag plate.
+// Whether the glyphs can be scaled with the layout's profile; reports it if not.
+inline bool tag_profile_valid(const TagLayout& layout) {
+	if (layout.profile().valid()) return true;
+	std::cerr << Red << "      Error: The scale profile has invalid knots." << ColorEnd << std::endl;
+	return false;
+}
+
+struct Glyph_Placement {
+	std::shared_ptr<const Glyph_Font::Glyph> glyph;
+	Vector offset;
+};
+
+// Appends every placed glyph to Tag_Mesh in a single pass. The element counts
+// are summed and reserved once, then each shared glyph is joined straight from
+// the decode cache. This skips the per-glyph working copy entirely;
+// copy_face_graph instead builds descriptor maps and grows the mesh one
+// element at a time. The appended points are then scaled in one pass and each
+// glyph's vertex range is moved into place. False, with nothing appended, when
+// the layout's scale profile is invalid.
+inline bool assemble_tag_mesh(const std::vector<Glyph_Placement>& placements, const TagLayout& layout, Mesh& Tag_Mesh) {
+	Stage_Timer timer("tag_assembly", &Tag_Mesh);
+	if (!tag_profile_valid(layout)) return false;
+	Mesh::size_type nv = Tag_Mesh.num_vertices(), ne = Tag_Mesh.num_edges(), nf = Tag_Mesh.num_faces();
+	for (const Glyph_Placement& placed : placements) {
+		nv += placed.glyph->solid->num_vertices();
+		ne += placed.glyph->solid->num_edges();
+		nf += placed.glyph->solid->num_faces();
+	}
+	Tag_Mesh.reserve(nv, ne, nf);
+
+	Mesh::size_type first = Tag_Mesh.num_vertices();
+	std::vector<Mesh::size_type> ends;
+	ends.reserve(placements.size());
+	for (const Glyph_Placement& placed : placements) {
+		Tag_Mesh.join(*placed.glyph->solid);
+		ends.push_back(Tag_Mesh.num_vertices() - first);
+	}
+
+	{
+		Point_SoA points(Tag_Mesh, first);
+		points.scale_profile(layout.profile());
+		for (std::size_t g = 0; g < placements.size(); ++g) {
+			const Vector& offset = placements[g].offset;
+			points.translate(offset.x(), offset.y(), offset.z(), g == 0 ? 0 : ends[g - 1], ends[g]);
+		}
+	}
+	if (DEBUG) std::cout << Yellow << "      Tag assembled:  " << ColorEnd
+		<< Tag_Mesh.number_of_vertices() << " vertices, " << Tag_Mesh.number_of_faces() << " faces" << std::endl;
+	return true;
+}
+
+// Lays the ID out on the tag plate in 2D, from the glyph outline boxes only,
+// before any mesh work. Lines break at '|' or a newline, and where letters
+// follow digits (the case number on the first line, the model code below it).
+// The first line starts at offsetX, later ones at lineStartX, each lower by
+// the height of its first glyph plus Yspacing. Glyphs advance by their width
+// plus Xspacing.
+//
+// Text that overflows the plate is fitted when fitToPlate is set: the widest
+// line is split near its middle while there are fewer than maxLines lines,
+// the split needing the least shrinking wins, and glyphs and spacing shrink
+// by that factor. Returns false, and builds nothing, when the ID has a
+// character the font lacks or does not fit even at minScale (at all,
+// without fitToPlate). placed receives the layout the glyphs were placed with.
+inline bool layout_tag(const std::string& ID_Str, const TagLayout& layout, std::vector<Glyph_Placement>& placements, TagLayout& placed) {
+	Stage_Timer timer("glyph_load");
+	Glyph_Font& font = Glyph_Font::active();
+	std::vector<std::size_t> lineStarts(1, 0);
+	bool lastWasDigit = false;
+	for (char c : ID_Str) {
+		if (c == '|' || c == '\n') {
+			if (placements.size() > lineStarts.back()) lineStarts.push_back(placements.size());
+			lastWasDigit = false;
+			continue;
+		}
+		std::shared_ptr<const Glyph_Font::Glyph> glyph = font.glyph(c);
+		if (!glyph) {
+			std::cerr << Red << "      ID has a character the font lacks:  " << ColorEnd << ID_Str << " ('" << c << "')" << std::endl;
+			return false;
+		}
+		if (std::isdigit(static_cast<unsigned char>(c))) {
+			lastWasDigit = true;
+		}
+		else if (lastWasDigit) {
+			if (placements.size() > lineStarts.back()) lineStarts.push_back(placements.size());
+			lastWasDigit = false;
+		}
+		placements.push_back({ std::move(glyph), Vector(0, 0, 0) });
+	}
+	if (placements.empty()) {
+		std::cerr << Red << "      No glyphs for the ID:  " << ColorEnd << ID_Str << std::endl;
+		return false;
+	}
+
+	placed = layout;
+	auto box_of = [&](std::size_t i) { return placements[i].glyph->outline.box; };
+	auto line_end = [&](const std::vector<std::size_t>& starts, std::size_t line) {
+		return line + 1 < starts.size() ? starts[line + 1] : placements.size();
+	};
+	// Places every glyph at scale factor k and returns the extents of each line.
+	auto place = [&](const std::vector<std::size_t>& starts, double k) {
+		placed.XYscale = layout.XYscale * k;
+		placed.XYtopscale = layout.XYtopscale * k;
+		placed.Xspacing = layout.Xspacing * k;
+		placed.Yspacing = layout.Yspacing * k;
+		double extent = std::max(placed.XYscale, placed.XYtopscale);
+		std::vector<CGAL::Bbox_2> lines(starts.size(), CGAL::Bbox_2());
+		double y = layout.offsetY;
+		for (std::size_t line = 0; line < starts.size(); ++line) {
+			std::size_t begin = starts[line], end = line_end(starts, line);
+			if (line > 0) y -= (box_of(begin).ymax() - box_of(begin).ymin()) * placed.XYscale + placed.Yspacing;
+			double x = line == 0 ? layout.offsetX : layout.lineStartX;
+			for (std::size_t i = begin; i < end; ++i) {
+				CGAL::Bbox_2 box = box_of(i);
+				placements[i].offset = Vector(x, y, layout.offsetZ + layout.zDepth);
+				lines[line] += CGAL::Bbox_2(x + box.xmin() * extent, y + box.ymin() * extent, x + box.xmax() * extent, y + box.ymax() * extent);
+				x += (box.xmax() - box.xmin()) * placed.XYscale + placed.Xspacing;
+			}
+		}
+		return lines;
+	};
+	auto block_of = [](const std::vector<CGAL::Bbox_2>& lines) {
+		CGAL::Bbox_2 block;
+		for (const CGAL::Bbox_2& line : lines) block += line;
+		return block;
+	};
+	double plateWidth = layout.plateMaxX - layout.plateMinX, plateHeight = layout.plateMaxY - layout.plateMinY;
+	auto fit_scale = [&](const std::vector<std::size_t>& starts) {
+		CGAL::Bbox_2 block = block_of(place(starts, 1.0));
+		return std::min({ 1.0, plateWidth / (block.xmax() - block.xmin()), plateHeight / (block.ymax() - block.ymin()) });
+	};
+	// Splits the widest line at the glyph edge closest to its middle.
+	auto split_widest = [&](std::vector<std::size_t>& starts) {
+		std::vector<CGAL::Bbox_2> lines = place(starts, 1.0);
+		std::size_t widest = starts.size();
+		double widestSpan = 0.0;
+		for (std::size_t line = 0; line < starts.size(); ++line) {
+			double span = lines[line].xmax() - lines[line].xmin();
+			if (line_end(starts, line) - starts[line] >= 2 && (widest == starts.size() || span > widestSpan)) {
+				widest = line;
+				widestSpan = span;
+			}
+		}
+		if (widest == starts.size()) return false;
+		double middle = (lines[widest].xmin() + lines[widest].xmax()) / 2.0;
+		std::size_t split = starts[widest] + 1;
+		double splitDistance = std::numeric_limits<double>::infinity();
+		for (std::size_t i = starts[widest] + 1; i < line_end(starts, widest); ++i) {
+			double distance = std::abs(placements[i].offset.x() + box_of(i).xmin() * placed.XYscale - middle);
+			if (distance < splitDistance) {
+				split = i;
+				splitDistance = distance;
+			}
+		}
+		starts.insert(starts.begin() + widest + 1, split);
+		return true;
+	};
+
+	double k = fit_scale(lineStarts);
+	if (layout.fitToPlate && k < 1.0) {
+		std::vector<std::size_t> starts(lineStarts);
+		while (k < 1.0 && static_cast<int>(starts.size()) < layout.maxLines && split_widest(starts)) {
+			double candidate = fit_scale(starts);
+			if (candidate > k) {
+				k = candidate;
+				lineStarts = starts;
+			}
+		}
+	}
+	double required = layout.fitToPlate ? layout.minScale : 1.0;
+	if (k < required - 1e-9) {
+		std::cerr << Red << "      ID does not fit on the tag plate:  " << ColorEnd << ID_Str
+			<< " (needs " << k * 100.0 << "% size, minimum " << required * 100.0 << "%)" << std::endl;
+		return false;
+	}
+	std::vector<CGAL::Bbox_2> lines = place(lineStarts, k);
+
+	// Shift whole lines: onto the plate center, or just back onto the plate after fitting
+	CGAL::Bbox_2 block = block_of(lines);
+	double dy = 0.0;
+	if (layout.center) dy = (layout.plateMinY + layout.plateMaxY) / 2.0 - (block.ymin() + block.ymax()) / 2.0;
+	else if (layout.fitToPlate) dy = std::clamp(0.0, layout.plateMinY - block.ymin(), std::max(layout.plateMinY - block.ymin(), layout.plateMaxY - block.ymax()));
+	for (std::size_t line = 0; line < lineStarts.size(); ++line) {
+		double dx = 0.0;
+		if (layout.center) dx = (layout.plateMinX + layout.plateMaxX) / 2.0 - (lines[line].xmin() + lines[line].xmax()) / 2.0;
+		else if (layout.fitToPlate) dx = std::clamp(0.0, layout.plateMinX - lines[line].xmin(), std::max(layout.plateMinX - lines[line].xmin(), layout.plateMaxX - lines[line].xmax()));
+		for (std::size_t i = lineStarts[line]; i < line_end(lineStarts, line); ++i) placements[i].offset = placements[i].offset + Vector(dx, dy, 0);
+	}
+	if (DEBUG && k < 1.0) std::cout << Yellow << "      Tag fitted:  " << ColorEnd << lineStarts.size() << " lines at " << k * 100.0 << "% size" << std::endl;
+	return true;
+}
+
+// The layout pre-pass alone: whether create_fixture would accept the ID.
+inline bool tag_fits(std::string ID_Str, const TagLayout& layout = TagLayout()) {
+	std::transform(ID_Str.begin(), ID_Str.end(), ID_Str.begin(), [](unsigned char c) { return std::toupper(c); });
+	TagLayout placed;
+	std::vector<Glyph_Placement> placements;
+	placements.reserve(ID_Str.size());
+	return tag_profile_valid(layout) && layout_tag(ID_Str, layout, placements, placed);
+}
+
+// Engraves the ID into the fixture. False if the ID does not fit the tag plate
+// (nothing is built), the layout's scale profile is invalid (checked before
+// anything else), the subtraction fails or the result cannot be put in
+// canonical order (-CO 1).
+inline bool create_fixture(std::string ID_Str, Mesh Fixture_Mesh, Mesh& Result_Mesh, const TagLayout& requested = TagLayout()) {
+	if (!tag_profile_valid(requested)) {
+		Result_Mesh.clear();
+		return false;
+	}
+	Mesh Tag_Mesh;
+
+	std::transform(ID_Str.begin(), ID_Str.end(), ID_Str.begin(), [](unsigned char c) { return std::toupper(c); });
+
+	static const bool validate = std::getenv("FIXTURE_VALIDATE_ENGRAVING") != nullptr;
+	bool engraved = false;
+	std::vector<Glyph_Placement> placements;
+	placements.reserve(ID_Str.size());
+	TagLayout layout;
+	bool fits = layout_tag(ID_Str, requested, placements, layout);
+	if (fits) {
+		// The pockets are planar cuts into the tag plate, so try them in 2D first.
+		if (ENGRAVE_2D) {
+			Stage_Timer timer("engrave", &Result_Mesh);
+			engraved = engrave_tag(Fixture_Mesh, placements, layout.profile(), Result_Mesh);
+			++(engraved ? engraved_fixtures : engrave_fallbacks);
+		}
+		if (!engraved || validate) fits = assemble_tag_mesh(placements, layout, Tag_Mesh);
+	}
+	if (!fits) {
+		Result_Mesh.clear();
+		return false;
+	}
+
+	if (engraved && validate) {
+		Mesh Reference_Mesh;
+		if (boolean_operation(Fixture_Mesh, Tag_Mesh, Reference_Mesh, Boolean_Op::Difference)) {
+			double planar = PMP::volume(Result_Mesh), reference = PMP::volume(Reference_Mesh);
+			if (std::abs(planar - reference) > 1e-6 * std::max(1.0, std::abs(reference))) {
+				std::cerr << Red << "      Engraving differs from the 3D boolean:  " << ColorEnd
+					<< "volume " << planar << " vs " << reference << std::endl;
+				std::swap(Result_Mesh, Reference_Mesh);
+			}
+		}
+	}
+	else if (!engraved) {
+		Stage_Timer timer("boolean", &Result_Mesh);
+		Result_Mesh.clear();
+		if (!boolean_operation(Fixture_Mesh, Tag_Mesh, Result_Mesh, Boolean_Op::Difference)) {
+			std::cerr << Red << "      Subtraction operation failed." << ColorEnd << std::endl;
+			return false;
+		}
+	}
+	return !compact_mesh(Result_Mesh).failed;
+}
+
+inline void settle_mesh_z0(Mesh& mesh) {
+	double min_z = std::numeric_limits<double>::infinity();
+	for (Vertex_index v : mesh.vertices()) min_z = std::min(min_z, mesh.point(v).z());
+	if (mesh.is_empty()) min_z = 0.0;
+	if (DEBUG) std::cout << Yellow << "      Settling mesh at Z:  " << ColorEnd << -min_z << std::endl;
+	for (Vertex_index v : mesh.vertices()) mesh.point(v) = mesh.point(v) + Vector(0, 0, -min_z);
+}
+
+// Box from bottom_z up to height that cut_mesh subtracts from the model.
+inline void make_cut_clipper(double height, Mesh& clipper) {
+	double size = 100.0, bottom_z = -10;
+	clipper.clear();
+	Vertex_index v0 = clipper.add_vertex(Point(-size, -size, height));
+	Vertex_index v1 = clipper.add_vertex(Point(size, -size, height));
+	Vertex_index v2 = clipper.add_vertex(Point(size, size, height));
+	Vertex_index v3 = clipper.add_vertex(Point(-size, size, height));
+	Vertex_index v4 = clipper.add_vertex(Point(-size, -size, bottom_z));
+	Vertex_index v5 = clipper.add_vertex(Point(size, -size, bottom_z));
+	Vertex_index v6 = clipper.add_vertex(Point(size, size, bottom_z));
+	Vertex_index v7 = clipper.add_vertex(Point(-size, size, bottom_z));
+	// Top face
+	clipper.add_face(v0, v1, v2);
+	clipper.add_face(v2, v3, v0);
+	// Bottom face
+	clipper.add_face(v4, v6, v5);
+	clipper.add_face(v6, v4, v7);
+	// Four side faces
+	clipper.add_face(v0, v4, v1);
+	clipper.add_face(v1, v4, v5);
+	clipper.add_face(v1, v5, v2);
+	clipper.add_face(v2, v5, v6);
+	clipper.add_face(v2, v6, v3);
+	clipper.add_face(v3, v6, v7);
+	clipper.add_face(v3, v7, v0);
+	clipper.add_face(v0, v7, v4);
+}
+
+// The clipper is one box, so the cut has no tiles and runs serially.
+inline void cut_mesh(Mesh& mesh, double model_height, double max_height) {
+	double height = model_height - max_height;
+	if (height >= 0) {
+		Stage_Timer timer("cut", &mesh);
+		Mesh clipper, Result_Mesh;
+		make_cut_clipper(height, clipper);
+
+		if (DEBUG) std::cout << Yellow << "      Cutting mesh at Z:  " << ColorEnd << height << std::endl;
+		if (!serial_boolean(mesh, clipper, Result_Mesh, Boolean_Op::Difference)) {
+			std::cerr << Red << "      Cutting mesh failed." << ColorEnd << std::endl;
+		}
+		settle_mesh_z0(Result_Mesh);
+		std::swap(mesh, Result_Mesh);
+	}
+	else {
+		if (DEBUG) std::cout << Yellow << "      No Cutting mesh needed:  " << ColorEnd << height << std::endl;
+	}
+}
+
+// Corefinement assumes inputs that do not intersect themselves, which scans
+// often do. The test costs a full pass over the model and its AABB tree, so
+// it only runs with DEBUG (-DB), to trace a failing union to the model. It
+// runs in parallel on the shared workers.
+inline void check_union_input(const Mesh& Model_Mesh) {
+	Stage_Timer timer("self_intersection", &Model_Mesh);
+	bool intersecting = with_fixture_threads([&] { return PMP::does_self_intersect<Concurrency_Tag>(Model_Mesh); });
+	if (intersecting) std::cerr << Yellow << "      Warning: The model intersects itself, the union may fail." << ColorEnd << std::endl;
+}
+
+// The fixture and its tag are one closed part, so the union has no tiles and
+// runs serially. When the union fails both parts are kept side by side. False
+// only when the result cannot be written in canonical order (-CO 1).
+inline bool merge_model(Mesh& Model_Mesh, Mesh& Fixture_Tag_Mesh, Mesh& Result_Mesh) {
+	if (DEBUG) check_union_input(Model_Mesh);
+	{
+		Stage_Timer timer("union", &Result_Mesh);
+		Result_Mesh.clear();
+		if (!serial_boolean(Model_Mesh, Fixture_Tag_Mesh, Result_Mesh, Boolean_Op::Union)) {
+			std::cerr << Red << "      Model Addition failed." << ColorEnd << std::endl;
+			Result_Mesh.clear();
+			CGAL::copy_face_graph(Fixture_Tag_Mesh, Result_Mesh);
+			CGAL::copy_face_graph(Model_Mesh, Result_Mesh);
+			return !CANONICAL_OUTPUT || !compact_mesh(Result_Mesh, 0.0).failed;
+		}
+	}
+	return !compact_mesh(Result_Mesh).failed;
+}
+
+// Same as merge_model, but the union overwrites Model_Mesh so no third full
+// size mesh is alive during the boolean, and the result is compacted in place.
+inline bool merge_model_in_place(Mesh& Model_Mesh, Mesh& Fixture_Tag_Mesh) {
+	if (DEBUG) check_union_input(Model_Mesh);
+	{
+		Stage_Timer timer("union", &Model_Mesh);
+		if (!serial_boolean(Model_Mesh, Fixture_Tag_Mesh, Model_Mesh, Boolean_Op::Union)) {
+			std::cerr << Red << "      Model Addition failed." << ColorEnd << std::endl;
+			CGAL::copy_face_graph(Fixture_Tag_Mesh, Model_Mesh);
+			return !CANONICAL_OUTPUT || !compact_mesh(Model_Mesh, 0.0, true).failed;
+		}
+	}
+	return !compact_mesh(Model_Mesh, COMPACT_TOLERANCE, true).failed;
+}
+
+#endif // FIXTURE_MESH_H
@@ -0,0 +1,325 @@
+#ifndef FIXTURE_SERVER_H
+#define FIXTURE_SERVER_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET socket_t;
+const socket_t INVALID_SOCK = INVALID_SOCKET;
+inline void close_socket(socket_t s) { closesocket(s); }
+const int SEND_FLAGS = 0;
+#else
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int socket_t;
+const socket_t INVALID_SOCK = -1;
+inline void close_socket(socket_t s) { ::close(s); }
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#endif
+
+#include "Fixture_Common.h"
+#include "Concurrency.h"
+
+// Local socket front end for fixture generation. One request per connection:
+//
+//   client:  <request line>\n
+//   server:  OK <payload bytes> <milliseconds>\n<payload>
+//            ERR <message>\n
+//
+// The request line is handed to the handler as a job on the shared workers of
+// Concurrency.h, so fixtures share the one FIXTURE_THREADS budget with the
+// parallel sections inside them. "STATS" and
+// "SHUTDOWN" are answered directly by the accepting thread, which reads the
+// line under a receive timeout so a silent client cannot stall it. Failed
+// accepts back off while they look transient and stop the server otherwise.
+// A socket left at the path by an earlier server is replaced; any other file
+// there makes the server refuse to start.
+
+// How long the accepting thread waits for a request line.
+const int REQUEST_TIMEOUT_MS = 2000;
+
+inline bool send_all(socket_t s, const char* data, size_t size) {
+	while (size > 0) {
+		int sent = send(s, data, static_cast<int>(std::min<size_t>(size, 1 << 20)), SEND_FLAGS);
+		if (sent <= 0) return false;
+		data += sent;
+		size -= static_cast<size_t>(sent);
+	}
+	return true;
+}
+
+inline bool send_all(socket_t s, const std::string& data) {
+	return send_all(s, data.data(), data.size());
+}
+
+inline bool recv_line(socket_t s, std::string& line, size_t maxLength = 4096) {
+	line.clear();
+	char c;
+	while (line.size() < maxLength) {
+		int got = recv(s, &c, 1, 0);
+		if (got <= 0) return false;
+		if (c == '\n') {
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			return true;
+		}
+		line.push_back(c);
+	}
+	return false;
+}
+
+inline bool recv_all(socket_t s, std::string& data, size_t size) {
+	data.resize(size);
+	size_t received = 0;
+	while (received < size) {
+		int got = recv(s, &data[received], static_cast<int>(std::min<size_t>(size - received, 1 << 20)), 0);
+		if (got <= 0) return false;
+		received += static_cast<size_t>(got);
+	}
+	return true;
+}
+
+inline void set_receive_timeout(socket_t s, int milliseconds) {
+#ifdef _WIN32
+	DWORD timeout = static_cast<DWORD>(milliseconds);
+#else
+	timeval timeout{ milliseconds / 1000, (milliseconds % 1000) * 1000 };
+#endif
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+}
+
+// Whether the last failed accept is worth retrying: an aborted connection or
+// exhausted descriptors, not a broken listener.
+inline bool accept_error_is_transient() {
+#ifdef _WIN32
+	int error = WSAGetLastError();
+	return error == WSAEINTR || error == WSAECONNRESET || error == WSAEMFILE || error == WSAENOBUFS;
+#else
+	return errno == EINTR || errno == ECONNABORTED || errno == EPROTO || errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM;
+#endif
+}
+
+inline bool socket_startup() {
+#ifdef _WIN32
+	WSADATA wsaData;
+	return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+	return true;
+#endif
+}
+
+inline bool make_socket_address(const std::string& socketPath, sockaddr_un& address) {
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		std::cerr << Red << "      Error: Socket path too long:  " << ColorEnd << socketPath << std::endl;
+		return false;
+	}
+	std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+	return true;
+}
+
+// Whether socketPath names a socket, such as one a crashed server left behind.
+// Windows reports AF_UNIX sockets as reparse points of unknown type.
+inline bool is_socket_file(const std::string& socketPath) {
+#ifdef _WIN32
+	std::error_code ec;
+	fs::file_type type = fs::symlink_status(socketPath, ec).type();
+	return !ec && (type == fs::file_type::socket || type == fs::file_type::unknown);
+#else
+	struct stat info;
+	return ::lstat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode);
+#endif
+}
+
+// Clears socketPath for bind: a leftover socket is removed, anything else
+// there is kept and refused.
+inline bool claim_socket_path(const std::string& socketPath) {
+	std::error_code ec;
+	if (!fs::exists(fs::symlink_status(socketPath, ec))) return true;
+	if (is_socket_file(socketPath) && std::remove(socketPath.c_str()) == 0) return true;
+	std::cerr << Red << "      Error: Not a socket, refusing to replace:  " << ColorEnd << socketPath << std::endl;
+	return false;
+}
+
+class Fixture_Server {
+public:
+	// Returns true and fills payload (may stay empty) on success, or false and fills error.
+	typedef std::function<bool(const std::string& request, std::string& payload, std::string& error)> Handler;
+
+	Fixture_Server(const std::string& socketPath, Handler handler)
+		: socketPath(socketPath), handler(std::move(handler)) {}
+
+	// Serves requests until a SHUTDOWN request arrives. False if the server
+	// could not start or accept failed for good.
+	bool run() {
+		sockaddr_un address;
+		if (!socket_startup() || !make_socket_address(socketPath, address) || !claim_socket_path(socketPath)) return false;
+
+		socket_t listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener == INVALID_SOCK) {
+			std::cerr << Red << "      Error: Cannot create socket." << ColorEnd << std::endl;
+			return false;
+		}
+		if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0) {
+			std::cerr << Red << "      Error: Cannot listen on:  " << ColorEnd << socketPath << std::endl;
+			close_socket(listener);
+			return false;
+		}
+
+		bool ok = true;
+		{
+			Task_Batch connections;
+			std::cout << Green << "      Listening on " << ColorEnd << socketPath
+				<< Yellow << "  (" << connections.size() << " workers)" << ColorEnd << std::endl;
+
+			std::chrono::milliseconds backoff(0);
+			for (;;) {
+				socket_t client = accept(listener, nullptr, nullptr);
+				if (client == INVALID_SOCK) {
+					if (!accept_error_is_transient()) {
+						std::cerr << Red << "      Error: Cannot accept connections on:  " << ColorEnd << socketPath << std::endl;
+						ok = false;
+						break;
+					}
+					backoff = std::min(std::chrono::milliseconds(1000), std::max(std::chrono::milliseconds(10), backoff * 2));
+					std::this_thread::sleep_for(backoff);
+					continue;
+				}
+				backoff = std::chrono::milliseconds(0);
+				auto received = std::chrono::steady_clock::now();
+				set_receive_timeout(client, REQUEST_TIMEOUT_MS);
+
+				std::string request;
+				if (!recv_line(client, request)) {
+					close_socket(client);
+					continue;
+				}
+				if (request == "STATS") {
+					send_all(client, stats_line() + "\n");
+					close_socket(client);
+					continue;
+				}
+				if (request == "SHUTDOWN") {
+					send_all(client, "OK 0 0\n");
+					close_socket(client);
+					break;
+				}
+
+				queued++;
+				connections.run([this, client, request, received] { serve(client, request, received); });
+			}
+			connections.wait();
+		}
+
+		close_socket(listener);
+		if (is_socket_file(socketPath)) std::remove(socketPath.c_str());
+		std::cout << Yellow << "      Server stopped. " << ColorEnd << stats_line() << std::endl;
+		return ok;
+	}
+
+	std::string stats_line() {
+		std::vector<double> sorted;
+		{
+			std::lock_guard<std::mutex> lock(statsMutex);
+			sorted = latencies;
+		}
+		std::sort(sorted.begin(), sorted.end());
+		auto percentile = [&sorted](double p) {
+			if (sorted.empty()) return 0.0;
+			return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5))];
+		};
+		std::ostringstream os;
+		os << "STATS queued=" << queued.load() << " active=" << active.load()
+			<< " completed=" << completed.load() << " failed=" << failed.load()
+			<< " p50_ms=" << percentile(0.50) << " p90_ms=" << percentile(0.90)
+			<< " p99_ms=" << percentile(0.99) << " max_ms=" << (sorted.empty() ? 0.0 : sorted.back());
+		return os.str();
+	}
+
+private:
+	void serve(socket_t client, const std::string& request, std::chrono::steady_clock::time_point received) {
+		queued--;
+		active++;
+		std::string payload, error;
+		bool ok = false;
+		try {
+			ok = handler(request, payload, error);
+		}
+		catch (const std::exception& e) {
+			error = e.what();
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - received).count();
+
+		if (ok) {
+			std::ostringstream header;
+			header << "OK " << payload.size() << " " << static_cast<long long>(ms) << "\n";
+			if (send_all(client, header.str())) send_all(client, payload);
+			completed++;
+		}
+		else {
+			std::replace(error.begin(), error.end(), '\n', ' ');
+			send_all(client, "ERR " + (error.empty() ? std::string("failed") : error) + "\n");
+			failed++;
+		}
+		close_socket(client);
+		active--;
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		if (latencies.size() < maxLatencySamples) latencies.push_back(ms);
+		else latencies[nextSample] = ms;
+		nextSample = (nextSample + 1) % maxLatencySamples;
+	}
+
+	std::string socketPath;
+	Handler handler;
+	std::atomic<int> queued{ 0 }, active{ 0 }, completed{ 0 }, failed{ 0 };
+	std::mutex statsMutex;
+	static const size_t maxLatencySamples = 4096;
+	std::vector<double> latencies;
+	size_t nextSample = 0;
+};
+
+// Sends one request to a running server. Returns false if the server could not
+// be reached; otherwise status holds the response line and payload its bytes.
+inline bool fixture_request(const std::string& socketPath, const std::string& request, std::string& status, std::string& payload) {
+	sockaddr_un address;
+	if (!socket_startup() || !make_socket_address(socketPath, address)) return false;
+
+	socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == INVALID_SOCK) return false;
+	if (connect(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		std::cerr << Red << "      Error: Cannot connect to:  " << ColorEnd << socketPath << std::endl;
+		close_socket(s);
+		return false;
+	}
+
+	payload.clear();
+	bool ok = send_all(s, request + "\n") && recv_line(s, status);
+	if (ok && status.rfind("OK ", 0) == 0) {
+		size_t size = std::strtoull(status.c_str() + 3, nullptr, 10);
+		ok = recv_all(s, payload, size);
+	}
+	close_socket(s);
+	return ok;
+}
+
+#endif // FIXTURE_SERVER_H
@@ -0,0 +1,401 @@
+#ifndef GLYPH_FONT_H
+#define GLYPH_FONT_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "OCR_font_STL.h"
+
+#include <CGAL/Constrained_Delaunay_triangulation_2.h>
+#include <CGAL/Polygon_2_algorithms.h>
+#include <CGAL/Triangulation_face_base_with_info_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+#include <CGAL/IO/STL.h>
+
+// Vector outlines of the tag font.
+//
+// A glyph is a set of closed 2D loops plus the z range it is extruded over.
+// The embedded glyphs are prisms whose walls widen slightly towards the top,
+// so each loop keeps the bottom and the top end of every wall edge; both are
+// read off the decoded STL. An outline font file can replace them (and add any
+// character) without rebuilding OCR_font_STL.h; its walls are straight:
+//
+//   # comments and blank lines are skipped
+//   height 5.165            z range of the extruded glyphs, from 0
+//   glyph A
+//   loop
+//   -4.9 -7.6               one "x y" point per line, the loop closes itself
+//   ...
+//   loop                    more loops for holes, any orientation
+//
+// The layout and the 2D engraving work on the outlines; a solid is extruded
+// from them once per glyph and shared, for the 3D boolean fallback.
+
+// One wall edge of a glyph, from a bottom cap vertex up to a top cap vertex.
+// A straight wall has both ends at the same (x, y).
+struct Glyph_Edge {
+	Kernel::Point_2 bottom, top;
+};
+
+// Closed loops of wall edges with the glyph on the left (outer loops
+// counter-clockwise). Consecutive edges share their bottom or their top point,
+// or span one wall quad.
+struct Glyph_Outline {
+	std::vector<std::vector<Glyph_Edge>> loops;
+	CGAL::Bbox_2 box;                                // both caps
+	double zmin = 0.0, zmax = 0.0;
+	std::vector<std::array<std::size_t, 3>> floor;   // bottom cap triangles, see cap_points
+};
+
+// Cap vertices closer than this to the lowest or highest z are on that cap (mm).
+// The embedded glyphs were exported in single precision, so their caps are
+// only flat to about 2e-4 mm; the outline puts them at exactly zmin and zmax.
+constexpr double GLYPH_CAP_TOLERANCE = 1e-3;
+
+// Appends the distinct bottom (or top) points of a loop to points, in loop
+// order, and returns the index of each edge's point.
+inline std::vector<std::size_t> cap_points(const std::vector<Glyph_Edge>& loop, bool top, std::vector<Kernel::Point_2>& points) {
+	auto end_of = [top](const Glyph_Edge& e) { return top ? e.top : e.bottom; };
+	std::size_t first = points.size();
+	std::vector<std::size_t> index(loop.size());
+	for (std::size_t i = 0; i < loop.size(); ++i) {
+		if (i == 0 || end_of(loop[i]) != end_of(loop[i - 1])) points.push_back(end_of(loop[i]));
+		index[i] = points.size() - 1;
+	}
+	// Trailing edges on the first point close the loop
+	if (points.size() - first > 1 && points.back() == points[first]) {
+		points.pop_back();
+		for (std::size_t i = loop.size(); i-- > 0 && index[i] == points.size();) index[i] = first;
+	}
+	return index;
+}
+
+// The outline of a prism with flat caps: every other face is a wall triangle
+// from one cap to the other, so the walls may be straight or drafted. Cap
+// vertices are snapped to zmin and zmax within GLYPH_CAP_TOLERANCE. False for
+// anything else, such as a chamfered or rounded glyph.
+inline bool prism_outline(const Mesh& prism, Glyph_Outline& outline) {
+	if (prism.is_empty() || !CGAL::is_closed(prism) || !CGAL::is_triangle_mesh(prism)) return false;
+	double zmin = std::numeric_limits<double>::infinity(), zmax = -zmin;
+	for (Vertex_index v : prism.vertices()) {
+		zmin = std::min(zmin, prism.point(v).z());
+		zmax = std::max(zmax, prism.point(v).z());
+	}
+	if (zmax - zmin <= 2 * GLYPH_CAP_TOLERANCE) return false;
+	auto at_bottom = [&](Vertex_index v) { return prism.point(v).z() - zmin <= GLYPH_CAP_TOLERANCE; };
+	auto at_top = [&](Vertex_index v) { return zmax - prism.point(v).z() <= GLYPH_CAP_TOLERANCE; };
+	auto flat = [&](Vertex_index v) { return Kernel::Point_2(prism.point(v).x(), prism.point(v).y()); };
+
+	// Flat caps with nothing in between
+	for (Vertex_index v : prism.vertices()) {
+		if (!at_bottom(v) && !at_top(v)) return false;
+	}
+	auto on_cap = [&](Face_index f, bool top) {
+		if (f == Mesh::null_face()) return false;
+		for (Vertex_index v : vertices_around_face(prism.halfedge(f), prism)) {
+			if (top ? !at_top(v) : !at_bottom(v)) return false;
+		}
+		return true;
+	};
+	std::size_t walls = 0;
+	for (Face_index f : prism.faces()) {
+		if (!on_cap(f, false) && !on_cap(f, true)) ++walls;
+	}
+
+	// Each loop starts at a wall halfedge along the bottom cap border; it runs
+	// in loop order, since the cap faces down. The walk then goes from one
+	// rising (bottom to top) halfedge of the wall strip to the next.
+	outline = Glyph_Outline();
+	std::set<Halfedge_index> walked;
+	std::size_t walkedWalls = 0;
+	for (Halfedge_index g : prism.halfedges()) {
+		if (walked.count(g) || on_cap(prism.face(g), false) || !on_cap(prism.face(prism.opposite(g)), false)) continue;
+		std::vector<Glyph_Edge> loop;
+		Halfedge_index start = prism.next(g), r = start;
+		do {
+			if (!at_bottom(prism.source(r)) || !at_top(prism.target(r)) || loop.size() > walls) return false;
+			loop.push_back({ flat(prism.source(r)), flat(prism.target(r)) });
+			outline.box += loop.back().bottom.bbox() + loop.back().top.bbox();
+			Halfedge_index n = prism.next(prism.opposite(r));
+			if (!at_top(prism.target(n))) {
+				// The next wall rests on a bottom edge
+				if (!on_cap(prism.face(prism.opposite(n)), false) || !walked.insert(n).second) return false;
+				n = prism.next(n);
+			}
+			r = n;
+		} while (r != start);
+		walkedWalls += loop.size();
+		outline.loops.push_back(std::move(loop));
+	}
+	if (outline.loops.empty() || walkedWalls != walls) return false;
+	outline.zmin = zmin;
+	outline.zmax = zmax;
+	return true;
+}
+
+struct Outline_Face_Info {
+	bool visited = false, inside = false;
+};
+
+typedef CGAL::Triangulation_vertex_base_with_info_2<std::size_t, Kernel> Outline_Vb;
+typedef CGAL::Constrained_triangulation_face_base_2<Kernel> Outline_Cfb;
+typedef CGAL::Triangulation_face_base_with_info_2<Outline_Face_Info, Kernel, Outline_Cfb> Outline_Fb;
+typedef CGAL::Triangulation_data_structure_2<Outline_Vb, Outline_Fb> Outline_Tds;
+typedef CGAL::Constrained_Delaunay_triangulation_2<Kernel, Outline_Tds, CGAL::No_constraint_intersection_tag> Outline_CDT;
+
+// Triangulates the bottom (or top) cap: counter-clockwise triangles of
+// indices into the cap_points of all loops, inside the glyph (odd nesting).
+// False if the loops touch or cross.
+inline bool triangulate_cap(const Glyph_Outline& outline, bool top, std::vector<std::array<std::size_t, 3>>& triangles) {
+	std::vector<Kernel::Point_2> points;
+	std::vector<std::size_t> loopFirst;
+	for (const auto& loop : outline.loops) {
+		loopFirst.push_back(points.size());
+		cap_points(loop, top, points);
+		if (points.size() - loopFirst.back() < 3) return false;
+	}
+	loopFirst.push_back(points.size());
+
+	Outline_CDT cdt;
+	std::vector<Outline_CDT::Vertex_handle> handles;
+	for (const Kernel::Point_2& p : points) {
+		Outline_CDT::Vertex_handle handle = cdt.insert(p);
+		if (cdt.number_of_vertices() != handles.size() + 1) return false; // repeated point
+		handle->info() = handles.size();
+		handles.push_back(handle);
+	}
+	try {
+		for (std::size_t l = 0; l + 1 < loopFirst.size(); ++l) {
+			std::size_t first = loopFirst[l], count = loopFirst[l + 1] - first;
+			for (std::size_t i = 0; i < count; ++i) cdt.insert_constraint(handles[first + i], handles[first + (i + 1) % count]);
+		}
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+
+	std::queue<Outline_CDT::Face_handle> open;
+	cdt.infinite_face()->info().visited = true;
+	open.push(cdt.infinite_face());
+	while (!open.empty()) {
+		Outline_CDT::Face_handle f = open.front();
+		open.pop();
+		for (int i = 0; i < 3; ++i) {
+			Outline_CDT::Face_handle n = f->neighbor(i);
+			if (n->info().visited) continue;
+			n->info().visited = true;
+			n->info().inside = f->is_constrained(i) ? !f->info().inside : f->info().inside;
+			open.push(n);
+		}
+	}
+	triangles.clear();
+	for (Outline_CDT::Finite_faces_iterator f = cdt.finite_faces_begin(); f != cdt.finite_faces_end(); ++f) {
+		if (f->info().inside) triangles.push_back({ f->vertex(0)->info(), f->vertex(1)->info(), f->vertex(2)->info() });
+	}
+	return !triangles.empty();
+}
+
+// The closed solid of the outline between zmin and zmax.
+inline bool extrude_outline(const Glyph_Outline& outline, Mesh& solid) {
+	std::vector<std::array<std::size_t, 3>> bottomCap, topCap;
+	if (!triangulate_cap(outline, false, bottomCap) || !triangulate_cap(outline, true, topCap)) return false;
+
+	std::vector<Kernel::Point_2> bottomPoints, topPoints;
+	std::vector<std::vector<std::size_t>> bottomIndex, topIndex;
+	for (const auto& loop : outline.loops) {
+		bottomIndex.push_back(cap_points(loop, false, bottomPoints));
+		topIndex.push_back(cap_points(loop, true, topPoints));
+	}
+
+	solid.clear();
+	std::vector<Vertex_index> bottom, top;
+	for (const Kernel::Point_2& p : bottomPoints) bottom.push_back(solid.add_vertex(Point(p.x(), p.y(), outline.zmin)));
+	for (const Kernel::Point_2& p : topPoints) top.push_back(solid.add_vertex(Point(p.x(), p.y(), outline.zmax)));
+	bool manifold = true;
+	auto add = [&](Vertex_index a, Vertex_index b, Vertex_index c) { manifold = manifold && solid.add_face(a, b, c) != Mesh::null_face(); };
+	for (const auto& t : bottomCap) add(bottom[t[0]], bottom[t[2]], bottom[t[1]]);
+	for (const auto& t : topCap) add(top[t[0]], top[t[1]], top[t[2]]);
+	for (std::size_t l = 0; l < outline.loops.size(); ++l) {
+		const std::vector<std::size_t>& b = bottomIndex[l], & t = topIndex[l];
+		for (std::size_t p = 0; p < b.size(); ++p) {
+			std::size_t q = (p + 1) % b.size();
+			if (b[p] != b[q]) add(bottom[b[p]], bottom[b[q]], top[t[q]]);
+			if (t[p] != t[q]) add(bottom[b[p]], top[t[q]], top[t[p]]);
+		}
+	}
+	return manifold && CGAL::is_closed(solid);
+}
+
+// Reorients loops read from a file: outer loops counter-clockwise, holes clockwise.
+inline void orient_outline(Glyph_Outline& outline) {
+	std::vector<std::vector<Kernel::Point_2>> bottoms(outline.loops.size());
+	for (std::size_t i = 0; i < outline.loops.size(); ++i) cap_points(outline.loops[i], false, bottoms[i]);
+	for (std::size_t i = 0; i < outline.loops.size(); ++i) {
+		const auto& loop = bottoms[i];
+		int depth = 0;
+		for (std::size_t j = 0; j < bottoms.size(); ++j) {
+			const auto& other = bottoms[j];
+			if (j != i && CGAL::bounded_side_2(other.begin(), other.end(), loop.front(), Kernel()) == CGAL::ON_BOUNDED_SIDE) ++depth;
+		}
+		bool counterClockwise = CGAL::orientation_2(loop.begin(), loop.end(), Kernel()) == CGAL::COUNTERCLOCKWISE;
+		if (counterClockwise == (depth % 2 == 1)) std::reverse(outline.loops[i].begin(), outline.loops[i].end());
+	}
+}
+
+class Glyph_Font {
+public:
+	struct Glyph {
+		Glyph_Outline outline;
+		bool hasOutline = false;           // false for an embedded glyph that is not a prism
+		                                   // (outline.box is still its extent)
+		std::shared_ptr<const Mesh> solid; // extruded outline, or the decoded STL without one
+	};
+
+	// The font every fixture in this process is laid out with.
+	static Glyph_Font& active() {
+		static Glyph_Font font;
+		return font;
+	}
+
+	// Switches to the outlines of a font file. Call before any fixture is built.
+	bool load(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		std::stringstream contents;
+		contents << in.rdbuf();
+		if (!in) {
+			std::cerr << Red << "      Error: Cannot read the font file:  " << ColorEnd << path << std::endl;
+			return false;
+		}
+		std::map<char, Glyph_Outline> outlines;
+		if (!parse(contents.str(), outlines)) {
+			std::cerr << Red << "      Error: Invalid font file:  " << ColorEnd << path << std::endl;
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mtx);
+		fileOutlines = std::move(outlines);
+		fileSource = contents.str();
+		glyphs.clear();
+		if (DEBUG) std::cout << Yellow << "      Font loaded:  " << ColorEnd << fileOutlines.size() << " glyphs from " << path << std::endl;
+		return true;
+	}
+
+	// Null when the font has no such character. Built once, then shared by all threads.
+	std::shared_ptr<const Glyph> glyph(char c) {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			auto it = glyphs.find(c);
+			if (it != glyphs.end()) return it->second;
+		}
+		std::shared_ptr<const Glyph> built = build(c);
+		std::lock_guard<std::mutex> lock(mtx);
+		return glyphs.emplace(c, std::move(built)).first->second;
+	}
+
+	// The font file contents; empty while the embedded glyphs are used.
+	const std::string& source() const { return fileSource; }
+
+private:
+	std::shared_ptr<const Glyph> build(char c) {
+		auto built = std::make_shared<Glyph>();
+		auto solid = std::make_shared<Mesh>();
+		if (!fileSource.empty()) {
+			auto it = fileOutlines.find(c);
+			if (it == fileOutlines.end()) {
+				std::cerr << Red << "      Error: The font has no glyph for:  " << ColorEnd << c << std::endl;
+				return nullptr;
+			}
+			built->outline = it->second;
+			built->hasOutline = true;
+		}
+		else {
+			const char key[] = { c, '\0' };
+			const STLData* data = find_STL_data(key);
+			if (!data) {
+				std::cerr << Red << "      Error: No STL data available for:  " << ColorEnd << key << std::endl;
+				return nullptr;
+			}
+			std::istringstream iss(std::string(reinterpret_cast<const char*>(data->data), data->size), std::ios::binary);
+			if (!CGAL::IO::read_STL(iss, *solid)) return nullptr;
+			built->hasOutline = prism_outline(*solid, built->outline);
+		}
+		// The extruded prism has the same shape with the fewest triangles.
+		Mesh extruded;
+		if (built->hasOutline && extrude_outline(built->outline, extruded) && triangulate_cap(built->outline, false, built->outline.floor)) {
+			*solid = std::move(extruded);
+		}
+		else {
+			if (!fileSource.empty()) return nullptr;
+			built->hasOutline = false;
+			built->outline = Glyph_Outline(); // the layout still needs its extents
+			for (Vertex_index v : solid->vertices()) built->outline.box += Kernel::Point_2(solid->point(v).x(), solid->point(v).y()).bbox();
+		}
+		if (DEBUG) std::cout << Yellow << "      Glyph ready:  " << ColorEnd << c << " (" << solid->number_of_faces() << " faces)" << std::endl;
+		built->solid = std::move(solid);
+		return built;
+	}
+
+	static bool parse(const std::string& text, std::map<char, Glyph_Outline>& outlines) {
+		std::istringstream in(text);
+		std::string line, word;
+		double height = 5.0;
+		Glyph_Outline* current = nullptr;
+		while (std::getline(in, line)) {
+			std::istringstream fields(line);
+			if (!(fields >> word) || word[0] == '#') continue;
+			if (word == "height") {
+				if (!(fields >> height) || height <= 0) return false;
+			}
+			else if (word == "glyph") {
+				if (!(fields >> word) || word.size() != 1) return false;
+				current = &outlines[static_cast<char>(std::toupper(static_cast<unsigned char>(word[0])))];
+				*current = Glyph_Outline();
+			}
+			else if (word == "loop") {
+				if (!current) return false;
+				current->loops.emplace_back();
+			}
+			else {
+				double x, y;
+				std::istringstream point(line);
+				if (!current || current->loops.empty() || !(point >> x >> y)) return false;
+				Kernel::Point_2 p(x, y);
+				current->loops.back().push_back({ p, p });
+				current->box += p.bbox();
+			}
+		}
+		for (auto& entry : outlines) {
+			Glyph_Outline& outline = entry.second;
+			for (const auto& loop : outline.loops) {
+				if (loop.size() < 3) return false;
+			}
+			if (outline.loops.empty()) return false;
+			outline.zmin = 0.0;
+			outline.zmax = height;
+			orient_outline(outline);
+		}
+		return !outlines.empty();
+	}
+
+	std::mutex mtx;
+	std::map<char, std::shared_ptr<const Glyph>> glyphs;
+	std::map<char, Glyph_Outline> fileOutlines;
+	std::string fileSource;
+};
+
+#endif // GLYPH_FONT_H
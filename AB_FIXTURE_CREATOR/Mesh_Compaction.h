@@ -0,0 +1,268 @@
+#ifndef MESH_COMPACTION_H
+#define MESH_COMPACTION_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "Stage_Stats.h"
+
+#include <CGAL/Polygon_mesh_processing/polygon_soup_to_polygon_mesh.h>
+#include <CGAL/Polygon_mesh_processing/repair.h>
+
+// Post-boolean cleanup before a mesh is written.
+//
+// Corefinement leaves removed elements in the Surface_mesh, vertices a few
+// ulps apart where cuts met, and zero-area slivers along coplanar seams. The
+// mesh is rebuilt as a polygon soup: vertices closer than the tolerance are
+// welded (a point joins the first point of its tolerance-sized grid cell, or
+// of a neighbouring cell when it is within tolerance of it), faces that lose
+// a corner to the weld are dropped, and vertices and faces are renumbered
+// along a Morton curve so neighbours in space are neighbours in memory and in
+// the file. Slivers that keep three distinct corners cannot just be dropped,
+// that would open the mesh at their long edge; PMP::remove_degenerate_faces
+// collapses and flips them away on the rebuilt mesh instead. When the welded
+// soup no longer forms a valid mesh, or a closed input would come out open,
+// only the garbage collection is kept and Compaction_Stats::fallback says why
+// (the stats file counts these as "compact_fallback" stages).
+//
+// In low-memory mode (OCR_FIXTURE_TOOL -LM) there is no soup and no second
+// mesh: the garbage is collected and the degenerate faces are removed in
+// place, without weld or renumbering.
+//
+// With CANONICAL_OUTPUT the vertices are sorted by their coordinates instead
+// of the Morton curve. Vertex and face order then depend only on the geometry,
+// not on the order CGAL produced them in, so two engines that build the same
+// fixture write the same STL bytes. The order is applied on every path: after
+// the weld, without it (-WT 0), in low-memory mode (at the cost of one
+// rebuild) and after a fallback; a mesh that cannot be reordered is an error
+// (Compaction_Stats::failed), and the callers fail the fixture with it. The
+// weld then visits the points in that order too, so every cluster keeps its
+// smallest point whatever order the vertices came in.
+
+// Weld distance in mm; 0 turns compact_mesh into a plain collect_garbage.
+inline double COMPACT_TOLERANCE = 1e-5;
+
+// Sort by coordinates so output bytes are reproducible (-CO 1); also applies with no weld.
+inline bool CANONICAL_OUTPUT = false;
+
+struct Compaction_Stats {
+	std::size_t verticesBefore = 0, facesBefore = 0;
+	std::size_t verticesAfter = 0, facesAfter = 0;
+	std::size_t welded = 0, collapsed = 0, degenerate = 0;
+	bool rebuilt = false;           // false when only the garbage was collected
+	const char* fallback = nullptr; // why the rebuild was abandoned, if it was
+	bool failed = false;            // CANONICAL_OUTPUT was asked for and could not be applied
+};
+
+// Removes zero-area faces by edge collapses and flips, keeping the mesh valid.
+inline std::size_t remove_degenerate_triangles(Mesh& mesh) {
+	std::size_t faces = mesh.number_of_faces();
+	PMP::remove_degenerate_faces(mesh);
+	mesh.collect_garbage();
+	return faces - mesh.number_of_faces();
+}
+
+// Interleaves the low 21 bits of v with two zero bits between each.
+inline uint64_t morton_spread(uint64_t v) {
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffULL;
+	v = (v | v << 16) & 0x1f0000ff0000ffULL;
+	v = (v | v << 8) & 0x100f00f00f00f00fULL;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+	v = (v | v << 2) & 0x1249249249249249ULL;
+	return v;
+}
+
+struct Weld_Cell_Hash {
+	std::size_t operator()(const std::array<long long, 3>& c) const {
+		uint64_t h = static_cast<uint64_t>(c[0]) * 0x9e3779b97f4a7c15ULL;
+		h ^= static_cast<uint64_t>(c[1]) * 0xc2b2ae3d27d4eb4fULL + (h << 6) + (h >> 2);
+		h ^= static_cast<uint64_t>(c[2]) * 0x165667b19e3779f9ULL + (h << 6) + (h >> 2);
+		return static_cast<std::size_t>(h);
+	}
+};
+
+// Per-worker buffers of compact_mesh. They are cleared, not freed, between
+// meshes, so a worker compacting one fixture after another reuses the
+// capacity the last one left; only the weld cells' nodes and the face soup
+// are allocated anew. Buffers grown past keepVertices by a model-sized mesh
+// are freed again. compact_mesh never waits on other tasks, so a worker
+// cannot enter it twice at once.
+struct Compaction_Scratch {
+	static constexpr std::size_t keepVertices = std::size_t(1) << 20;
+
+	std::unordered_map<std::array<long long, 3>, std::size_t, Weld_Cell_Hash> cells;
+	std::vector<Vertex_index> visit;
+	std::vector<Point> points, sorted;
+	std::vector<std::size_t> welded, order, rank;
+	std::vector<uint64_t> codes;
+
+	static Compaction_Scratch& local() {
+		static thread_local Compaction_Scratch scratch;
+		return scratch;
+	}
+
+	void trim() {
+		if (points.capacity() > keepVertices || welded.capacity() > keepVertices) *this = Compaction_Scratch();
+	}
+};
+
+// Vertex order of a rebuilt mesh into order: by coordinates for canonical
+// output, along the Morton curve of their bounding box otherwise.
+inline void point_order(const std::vector<Point>& points, bool canonical, std::vector<std::size_t>& order, std::vector<uint64_t>& codes) {
+	order.resize(points.size());
+	std::iota(order.begin(), order.end(), 0);
+	if (canonical) {
+		std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return points[a] < points[b]; });
+		return;
+	}
+	CGAL::Bbox_3 bbox;
+	for (const Point& p : points) bbox += p.bbox();
+	codes.resize(points.size());
+	double span = std::max({ bbox.xmax() - bbox.xmin(), bbox.ymax() - bbox.ymin(), bbox.zmax() - bbox.zmin(), 1e-12 });
+	double cellsPerUnit = static_cast<double>(0x1fffff) / span;
+	for (std::size_t i = 0; i < points.size(); ++i) {
+		codes[i] = morton_spread(static_cast<uint64_t>((points[i].x() - bbox.xmin()) * cellsPerUnit))
+			| morton_spread(static_cast<uint64_t>((points[i].y() - bbox.ymin()) * cellsPerUnit)) << 1
+			| morton_spread(static_cast<uint64_t>((points[i].z() - bbox.zmin()) * cellsPerUnit)) << 2;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return codes[a] < codes[b]; });
+}
+
+// Rebuilds mesh on points in point_order, with every face on the point its
+// vertex maps to in welded and the faces sorted by their corners. Faces left
+// with fewer than three corners are counted in collapsed and dropped. Returns
+// why the rebuild was refused, with mesh untouched, or null.
+inline const char* rebuild_mesh(Mesh& mesh, const std::vector<Point>& points, const std::vector<std::size_t>& welded, bool canonical, std::size_t& collapsed) {
+	Compaction_Scratch& scratch = Compaction_Scratch::local();
+	std::vector<std::size_t>& order = scratch.order;
+	std::vector<std::size_t>& rank = scratch.rank;
+	std::vector<Point>& sorted = scratch.sorted;
+	point_order(points, canonical, order, scratch.codes);
+	rank.resize(points.size());
+	sorted.clear();
+	for (std::size_t i = 0; i < order.size(); ++i) {
+		rank[order[i]] = i;
+		sorted.push_back(points[order[i]]);
+	}
+
+	std::vector<std::vector<std::size_t>> polygons;
+	polygons.reserve(mesh.number_of_faces());
+	for (Face_index f : mesh.faces()) {
+		std::vector<std::size_t> polygon;
+		for (Vertex_index v : CGAL::vertices_around_face(mesh.halfedge(f), mesh)) {
+			std::size_t id = rank[welded[v.idx()]];
+			if (polygon.empty() || polygon.back() != id) polygon.push_back(id);
+		}
+		while (polygon.size() > 1 && polygon.front() == polygon.back()) polygon.pop_back();
+		if (polygon.size() < 3) {
+			++collapsed;
+			continue;
+		}
+		// Lowest corner first (orientation kept), then faces in the order of their corners
+		std::rotate(polygon.begin(), std::min_element(polygon.begin(), polygon.end()), polygon.end());
+		polygons.push_back(std::move(polygon));
+	}
+	std::sort(polygons.begin(), polygons.end());
+
+	if (!PMP::is_polygon_soup_a_polygon_mesh(polygons)) return "welded faces do not form a mesh";
+	Mesh rebuilt;
+	PMP::polygon_soup_to_polygon_mesh(sorted, polygons, rebuilt);
+	if (CGAL::is_closed(mesh) && !CGAL::is_closed(rebuilt)) return "welded mesh is open";
+	std::swap(mesh, rebuilt);
+	return nullptr;
+}
+
+inline Compaction_Stats compact_mesh(Mesh& mesh, double tolerance = COMPACT_TOLERANCE, bool lowMemory = false) {
+	Stage_Timer timer("compact", &mesh);
+	Compaction_Scratch& scratch = Compaction_Scratch::local();
+	Compaction_Stats stats;
+	mesh.collect_garbage();
+	stats.verticesBefore = stats.verticesAfter = mesh.number_of_vertices();
+	stats.facesBefore = stats.facesAfter = mesh.number_of_faces();
+	if ((tolerance <= 0.0 && !CANONICAL_OUTPUT) || mesh.is_empty()) return stats;
+
+	if (lowMemory) {
+		if (CGAL::is_triangle_mesh(mesh)) stats.degenerate = remove_degenerate_triangles(mesh);
+	}
+	else if (tolerance > 0.0) {
+		// Weld on a grid of tolerance-sized cells
+		const double toleranceSquared = tolerance * tolerance;
+		auto& cells = scratch.cells;
+		std::vector<Point>& points = scratch.points;
+		std::vector<std::size_t>& welded = scratch.welded;
+		std::vector<Vertex_index>& visit = scratch.visit;
+		cells.clear();
+		cells.reserve(mesh.number_of_vertices());
+		points.clear();
+		welded.resize(mesh.number_of_vertices());
+		visit.assign(mesh.vertices().begin(), mesh.vertices().end());
+		if (CANONICAL_OUTPUT) {
+			std::sort(visit.begin(), visit.end(), [&](Vertex_index a, Vertex_index b) { return mesh.point(a) < mesh.point(b); });
+		}
+		for (Vertex_index v : visit) {
+			const Point& p = mesh.point(v);
+			std::size_t match = points.size();
+			std::array<long long, 3> cell = { std::llround(std::floor(p.x() / tolerance)),
+				std::llround(std::floor(p.y() / tolerance)), std::llround(std::floor(p.z() / tolerance)) };
+			auto own = cells.find(cell);
+			if (own != cells.end()) match = own->second;
+			for (int d = 0; d < 27 && match == points.size(); ++d) {
+				std::array<long long, 3> near = { cell[0] + d % 3 - 1, cell[1] + d / 3 % 3 - 1, cell[2] + d / 9 - 1 };
+				auto it = cells.find(near);
+				if (it != cells.end() && CGAL::squared_distance(points[it->second], p) <= toleranceSquared) match = it->second;
+			}
+			if (match == points.size()) {
+				cells.emplace(cell, match);
+				points.push_back(p);
+			}
+			welded[v.idx()] = match;
+		}
+
+		if (const char* reason = rebuild_mesh(mesh, points, welded, CANONICAL_OUTPUT, stats.collapsed)) {
+			stats.fallback = reason;
+			{ Stage_Timer marker("compact_fallback"); }
+			if (DEBUG) std::cout << Yellow << "      Compaction skipped:  " << ColorEnd << reason << std::endl;
+		}
+		else {
+			stats.rebuilt = true;
+			stats.welded = stats.verticesBefore - points.size();
+			if (CGAL::is_triangle_mesh(mesh)) stats.degenerate = remove_degenerate_triangles(mesh);
+		}
+	}
+
+	// Canonical output never keeps CGAL's order: not without a weld, not after
+	// a fallback, and not after the degenerate faces were flipped away.
+	if (CANONICAL_OUTPUT && (!stats.rebuilt || stats.degenerate > 0)) {
+		std::vector<Point>& points = scratch.points;
+		std::vector<std::size_t>& identity = scratch.welded;
+		points.clear();
+		for (Vertex_index v : mesh.vertices()) points.push_back(mesh.point(v));
+		identity.resize(points.size());
+		std::iota(identity.begin(), identity.end(), 0);
+		std::size_t collapsed = 0;
+		if (const char* reason = rebuild_mesh(mesh, points, identity, true, collapsed)) {
+			stats.fallback = reason;
+			stats.failed = true;
+			std::cerr << Red << "      Error: Cannot write the mesh in canonical order:  " << ColorEnd << reason << std::endl;
+		}
+	}
+
+	scratch.trim();
+	stats.verticesAfter = mesh.number_of_vertices();
+	stats.facesAfter = mesh.number_of_faces();
+	if (DEBUG) std::cout << Yellow << "      Compacted mesh:  " << ColorEnd
+		<< stats.verticesBefore << " -> " << stats.verticesAfter << " vertices, "
+		<< stats.facesBefore << " -> " << stats.facesAfter << " faces ("
+		<< stats.welded << " welded, " << stats.collapsed << " collapsed, " << stats.degenerate << " degenerate)" << std::endl;
+	return stats;
+}
+
+#endif // MESH_COMPACTION_H
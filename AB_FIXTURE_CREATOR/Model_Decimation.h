@@ -0,0 +1,105 @@
+#ifndef MODEL_DECIMATION_H
+#define MODEL_DECIMATION_H
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "Fixture_Common.h"
+#include "Stage_Stats.h"
+
+#include <CGAL/AABB_face_graph_triangle_primitive.h>
+#include <CGAL/AABB_traits.h>
+#include <CGAL/AABB_tree.h>
+#include <CGAL/Surface_mesh_simplification/edge_collapse.h>
+#include <CGAL/Surface_mesh_simplification/Policies/Edge_collapse/Bounded_distance_placement.h>
+#include <CGAL/Surface_mesh_simplification/Policies/Edge_collapse/Constrained_placement.h>
+#include <CGAL/Surface_mesh_simplification/Policies/Edge_collapse/Count_ratio_stop_predicate.h>
+#include <CGAL/Surface_mesh_simplification/Policies/Edge_collapse/LindstromTurk_cost.h>
+#include <CGAL/Surface_mesh_simplification/Policies/Edge_collapse/LindstromTurk_placement.h>
+
+namespace SMS = CGAL::Surface_mesh_simplification;
+
+typedef CGAL::AABB_face_graph_triangle_primitive<Mesh> Fixture_Primitive;
+typedef CGAL::AABB_tree<CGAL::AABB_traits<Kernel, Fixture_Primitive>> Fixture_Tree;
+
+struct Decimation_Settings {
+	double keepDistance = 2.0; // mm around the fixture kept at full resolution
+	double maxError = 0.05;    // mm a collapse may move the surface away from the scan
+	double minRatio = 0.0;     // never go below this fraction of the model's edges
+};
+
+// Pre-union simplification of the patient model. Every edge with an endpoint
+// within keepDistance of the fixture is constrained, and the constrained
+// placement never moves a vertex on such an edge, so the contact region keeps
+// the scan's full resolution. Elsewhere edges are collapsed by Lindstrom-Turk
+// cost as long as the new vertex stays within maxError of the original scan
+// (collapses that would move it further are rejected) and more than minRatio
+// of the edges are left. The model must be triangulated; returns the number of
+// collapsed edges.
+inline int decimate_outside_fixture(Mesh& Model_Mesh, const Mesh& Fixture_Tag_Mesh, const Decimation_Settings& settings) {
+	Stage_Timer timer("decimate", &Model_Mesh);
+	if (settings.minRatio >= 1.0 || settings.maxError <= 0.0 || Model_Mesh.is_empty() || !CGAL::is_triangle_mesh(Model_Mesh)) return 0;
+
+	Fixture_Tree tree(faces(Fixture_Tag_Mesh).first, faces(Fixture_Tag_Mesh).second, Fixture_Tag_Mesh);
+	tree.accelerate_distance_queries();
+	double keepSquared = settings.keepDistance * settings.keepDistance;
+
+	auto nearMap = Model_Mesh.add_property_map<Vertex_index, bool>("v:near_fixture", false).first;
+	for (Vertex_index v : Model_Mesh.vertices()) {
+		nearMap[v] = !tree.empty() && tree.squared_distance(Model_Mesh.point(v)) <= keepSquared;
+	}
+
+	auto constrainedMap = Model_Mesh.add_property_map<Mesh::Edge_index, bool>("e:near_fixture", false).first;
+	for (Mesh::Edge_index e : Model_Mesh.edges()) {
+		Halfedge_index h = Model_Mesh.halfedge(e);
+		constrainedMap[e] = nearMap[Model_Mesh.source(h)] || nearMap[Model_Mesh.target(h)];
+	}
+
+	size_t facesBefore = Model_Mesh.number_of_faces();
+	// The bounded placement keeps its own copy of the input triangles to measure against.
+	typedef SMS::Bounded_distance_placement<SMS::LindstromTurk_placement<Mesh>> Bounded_placement;
+	SMS::Count_ratio_stop_predicate<Mesh> stop(settings.minRatio);
+	SMS::Constrained_placement<Bounded_placement, decltype(constrainedMap)> placement(constrainedMap, Bounded_placement(settings.maxError));
+	int removed = SMS::edge_collapse(Model_Mesh, stop,
+		CGAL::parameters::edge_is_constrained_map(constrainedMap)
+		.get_cost(SMS::LindstromTurk_cost<Mesh>())
+		.get_placement(placement));
+
+	Model_Mesh.remove_property_map(constrainedMap);
+	Model_Mesh.remove_property_map(nearMap);
+	Model_Mesh.collect_garbage();
+	if (DEBUG) std::cout << Yellow << "      Decimated model:  " << ColorEnd << facesBefore << " -> " << Model_Mesh.number_of_faces()
+		<< " faces (" << settings.keepDistance << " mm kept, " << settings.maxError << " mm max error)" << std::endl;
+	return removed;
+}
+
+// Ends an edge collapse early once cancel is set, otherwise asks stop.
+template <typename Stop>
+struct Cancellable_Stop_Predicate {
+	Stop stop;
+	const std::atomic<bool>* cancel;
+
+	template <typename... Args>
+	bool operator()(const Args&... args) const { return cancel->load() || stop(args...); }
+};
+
+// Coarse stand-in for a scan in interactive previews: a copy collapsed down to
+// about maxFaces faces with the default Lindstrom-Turk cost and placement, no
+// error bound. Meshes already that small (or not triangulated) are copied as is.
+// Setting cancel stops the collapse between two edges; false if it did.
+inline bool make_preview_proxy(const Mesh& Model_Mesh, Mesh& Proxy_Mesh, std::size_t maxFaces, const std::atomic<bool>* cancel = nullptr) {
+	Proxy_Mesh = Model_Mesh;
+	std::size_t faces = Proxy_Mesh.number_of_faces();
+	if (faces <= maxFaces || !CGAL::is_triangle_mesh(Proxy_Mesh)) return true;
+	static const std::atomic<bool> never{ false };
+	Cancellable_Stop_Predicate<SMS::Count_ratio_stop_predicate<Mesh>> stop{
+		SMS::Count_ratio_stop_predicate<Mesh>(static_cast<double>(maxFaces) / faces), cancel ? cancel : &never };
+	SMS::edge_collapse(Proxy_Mesh, stop);
+	if (stop.cancel->load()) return false;
+	Proxy_Mesh.collect_garbage();
+	if (DEBUG) std::cout << Yellow << "      Preview proxy:  " << ColorEnd << faces << " -> " << Proxy_Mesh.number_of_faces() << " faces" << std::endl;
+	return true;
+}
+
+#endif // MODEL_DECIMATION_H
@@ -9,8 +9,20 @@
 #include <string>
 #include <cmath>
 #include <map>
-#include "rang.hpp"
-#include "OCR_font_STL.h"
+#include <memory>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include "Fixture_Server.h" // winsock2.h has to come before anything that pulls in windows.h
+#include "Platform.h"
+#include "Fixture_Common.h"
+#include "Fixture_Mesh.h"
+#include "Fixture_Base.h"
+#include "Concurrency.h"
+#include "Model_Decimation.h"
+#include "Output_Writer.h"
+#include "Plate_Nesting.h"
+#include "Preview_Worker.h"
 //#include "VTK_Visualization.h
 
 #include <CGAL/Polygon_mesh_processing/transform.h>
@@ -24,11 +36,14 @@
 #include <CGAL/bounding_box.h>
 #include <CGAL/Polygon_mesh_processing/connected_components.h>
 #include <CGAL/Polygon_mesh_processing/repair.h>
+#include <CGAL/Polygon_mesh_processing/self_intersections.h>
 
+#ifndef FIXTURE_NO_VTK
 #include <vtkNew.h>
 #include <vtkPolyData.h>
 #include <vtkPoints.h>
 #include <vtkCellArray.h>
+#include <vtkDoubleArray.h>
 #include <vtkPolyDataMapper.h>
 #include <vtkActor.h>
 #include <vtkRenderer.h>
@@ -54,6 +69,7 @@
 #include <vtkProperty2D.h>
 #include <vtkSliderWidget.h>
 #include <vtkCommand.h>
+#endif
 
 //#include <QMainWindow>
 //#include <QListWidget>
@@ -64,43 +80,32 @@
 //#include <QVTKWidget.h>
 
 
-#define M_PI 3.14159265358979323846
-
-//<< Red << << ColorEnd <<
-auto ColorEnd = [](std::ostream& os) -> std::ostream& { return os << rang::fg::reset; };
-auto Red = [](std::ostream& os) -> std::ostream& { return os << rang::fg::red; };
-auto Green = [](std::ostream& os) -> std::ostream& { return os << rang::fg::green; };
-auto Yellow = [](std::ostream& os) -> std::ostream& { return os << rang::fg::yellow; };
-auto Blue = [](std::ostream& os) -> std::ostream& { return os << rang::fg::blue; };
-auto Magenta = [](std::ostream& os) -> std::ostream& { return os << rang::fg::magenta; };
-auto Cyan = [](std::ostream& os) -> std::ostream& { return os << rang::fg::cyan; };
-auto Gray = [](std::ostream& os) -> std::ostream& { return os << rang::fg::gray; };
-
-
-namespace PMP = CGAL::Polygon_mesh_processing;
-namespace fs = std::filesystem;
-bool DEBUG = false;
-
-typedef CGAL::Exact_predicates_inexact_constructions_kernel Kernel;
-typedef CGAL::Surface_mesh<Kernel::Point_3> Mesh;
-typedef Kernel::Point_3 Point;
-typedef Kernel::Vector_3 Vector;
-typedef Mesh::Vertex_index Vertex_index;
-typedef Mesh::Halfedge_index Halfedge_index;
-typedef Mesh::Face_index Face_index;
-typedef boost::graph_traits<Mesh>::face_descriptor face_descriptor;
 typedef CGAL::Aff_transformation_3<Kernel> Transformation;
 
-VTK_MODULE_INIT(vtkRenderingOpenGL2);
-VTK_MODULE_INIT(vtkInteractionStyle);
+#ifndef FIXTURE_NO_VTK
+// The VTK factories are registered when the viewer first opens, not at static
+// initialization, so runs that never show it do not pay for VTK at startup.
+// The set is what vtk_module_autoinit would register for the VTK components
+// in CMakeLists.txt: the implementations of RenderingCore (OpenGL2,
+// InteractionStyle, FreeType) and of RenderingOpenGL2 (UI, the platform
+// render window interactor). Keep the two lists in step.
+VTK_AUTOINIT_DECLARE(vtkInteractionStyle)
+VTK_AUTOINIT_DECLARE(vtkRenderingFreeType)
+VTK_AUTOINIT_DECLARE(vtkRenderingOpenGL2)
+VTK_AUTOINIT_DECLARE(vtkRenderingUI)
+
+void init_vtk_modules() {
+	static std::once_flag once;
+	std::call_once(once, [] {
+		VTK_AUTOINIT_CONSTRUCT(vtkInteractionStyle)
+		VTK_AUTOINIT_CONSTRUCT(vtkRenderingFreeType)
+		VTK_AUTOINIT_CONSTRUCT(vtkRenderingOpenGL2)
+		VTK_AUTOINIT_CONSTRUCT(vtkRenderingUI)
+	});
+}
 
 class C_InteractorStyle;
 
-vtkNew<vtkPolyDataMapper> staticMapper;
-vtkNew<vtkPolyDataMapper> movableMapper;
-vtkNew<vtkActor> staticActor;
-vtkNew<vtkActor> movableActor;
-
 double maxcut = 8.0, mincut = 0.0;
 
 class RotationSliderCallback : public vtkCommand {
@@ -127,8 +132,9 @@ public:
 			if (DEBUG) std::cout << Yellow << "      Rotation Slider : " << ColorEnd << value << std::endl;
 		}
 		char label[50];
-		sprintf_s(label, "%.1f", value);  // Format to two decimal places
+		snprintf(label, sizeof(label), "%.1f", value);  // Format to two decimal places
 		sliderRep->SetLabelFormat(label);
+		if (Preview) Preview->set_rotation(value);
 
 		sliderWidget->GetInteractor()->GetRenderWindow()->Render(); // Update the display
 	}
@@ -139,6 +145,9 @@ public:
 	void SetRotPtr(double* ptr) {
 		RotPtr = ptr;
 	}
+	void SetPreview(Preview_Worker* worker) {
+		Preview = worker;
+	}
 	double scaleValue(double input, double factor) {
 		double normalizedInput = input / factor;  // Normalize to -1 to 1
 		return factor * normalizedInput * normalizedInput * (input < 0 ? -1 : 1);  // Scale back to -180 to 180
@@ -147,6 +156,7 @@ public:
 private:
 	vtkActor* RotActor;
 	double* RotPtr = nullptr;
+	Preview_Worker* Preview = nullptr;
 };
 
 class CutSliderCallback : public vtkCommand
@@ -174,8 +184,9 @@ public:
 		}
 
 		char label[50];
-		sprintf_s(label, "%.1f", value);  // Format to two decimal places
+		snprintf(label, sizeof(label), "%.1f", value);  // Format to two decimal places
 		sliderRep->SetLabelFormat(label);
+		if (Preview) Preview->set_cut(value);
 
 		sliderWidget->GetInteractor()->GetRenderWindow()->Render(); // Update the display
 	}
@@ -186,10 +197,49 @@ public:
 	void SetCutHeightPtr(double* ptr) {
 		CutHeightPtr = ptr;
 	}
+	void SetPreview(Preview_Worker* worker) {
+		Preview = worker;
+	}
 
 private:
 	vtkActor* CuttingDisk;
 	double* CutHeightPtr = nullptr;
+	Preview_Worker* Preview = nullptr;
+};
+
+vtkNew<vtkPolyData> mesh_to_vtk(const Mesh& mesh);
+
+// Polls the preview worker from the render loop and swaps a finished preview
+// into the inset view. The mesh is kept here since its polydata reads the
+// points in place.
+class PreviewTimerCallback : public vtkCommand {
+public:
+	static PreviewTimerCallback* New() {
+		return new PreviewTimerCallback();
+	}
+
+	void Execute(vtkObject* caller, unsigned long, void*) override {
+		if (!Preview) return;
+		std::unique_ptr<Mesh> mesh = Preview->take();
+		if (!mesh) return;
+		PreviewMapper->SetInputData(mesh_to_vtk(*mesh));
+		Shown = std::move(mesh);
+		if (!PreviewActor->GetVisibility()) {
+			// From the first preview on, the inset shows the result instead of the bare model
+			InsetRenderer->RemoveActor(ModelActor);
+			PreviewActor->VisibilityOn();
+		}
+		vtkRenderWindowInteractor::SafeDownCast(caller)->GetRenderWindow()->Render();
+	}
+
+	Preview_Worker* Preview = nullptr;
+	vtkPolyDataMapper* PreviewMapper = nullptr;
+	vtkActor* PreviewActor = nullptr;
+	vtkActor* ModelActor = nullptr;
+	vtkRenderer* InsetRenderer = nullptr;
+
+private:
+	std::unique_ptr<Mesh> Shown;
 };
 
 class C_InteractorStyle : public vtkInteractorStyleTrackballCamera {
@@ -204,6 +254,7 @@ public:
 	bool IsMeshSelected = false;
 	int LastPosition[2] = { -1, -1 };
 	double X_offset, Y_offset;
+	Preview_Worker* Preview = nullptr;
 
 	C_InteractorStyle() : X_offset(0), Y_offset(0) {
 		this->Picker = vtkSmartPointer<vtkHardwarePicker>::New();
@@ -249,6 +300,7 @@ public:
 
 			X_offset = CurrentPos[0];
 			Y_offset = CurrentPos[1];
+			if (Preview) Preview->set_offset(X_offset, Y_offset);
 
 			if (DEBUG) std::cout << Yellow << "      Final position offset: " 
 				<< ColorEnd << "(" << CurrentPos[0] << ", " << CurrentPos[1] << ")" << std::endl;
@@ -371,23 +423,29 @@ public:
 };
 vtkStandardNewMacro(C_InteractorStyle);
 
+// The viewer reads the Surface_mesh point storage in place (EPICK points are
+// three packed doubles), so a large scan is not duplicated into VTK. VTK point
+// ids are the vertex indices, and the mesh must outlive the returned polydata.
 vtkNew<vtkPolyData> mesh_to_vtk(const Mesh& mesh) {
-	vtkNew<vtkPoints> points;
-	vtkNew<vtkCellArray> polygons;
-
-	for (auto v : mesh.vertices()) {
-		const Point& p = mesh.point(v);
-		points->InsertNextPoint(p.x(), p.y(), p.z());
+	static_assert(sizeof(Point) == 3 * sizeof(double), "EPICK points are expected to be three packed doubles");
+	vtkNew<vtkDoubleArray> coordinates;
+	coordinates->SetNumberOfComponents(3);
+	if (mesh.num_vertices() > 0) {
+		double* storage = const_cast<double*>(reinterpret_cast<const double*>(&mesh.point(Vertex_index(0))));
+		coordinates->SetArray(storage, static_cast<vtkIdType>(3 * mesh.num_vertices()), 1); // 1: VTK does not free it
 	}
+	vtkNew<vtkPoints> points;
+	points->SetData(coordinates);
 
+	vtkNew<vtkCellArray> polygons;
+	polygons->AllocateEstimate(mesh.number_of_faces(), 3);
+	std::vector<vtkIdType> polygon;
 	for (auto f : mesh.faces()) {
-		vtkNew<vtkIdList> polygon;
-		CGAL::Vertex_around_face_iterator<Mesh> vbegin, vend;
-		boost::tie(vbegin, vend) = vertices_around_face(mesh.halfedge(f), mesh);
-		for (; vbegin != vend; ++vbegin) {
-			polygon->InsertNextId(*vbegin);
+		polygon.clear();
+		for (Vertex_index v : vertices_around_face(mesh.halfedge(f), mesh)) {
+			polygon.push_back(static_cast<vtkIdType>(v));
 		}
-		polygons->InsertNextCell(polygon);
+		polygons->InsertNextCell(static_cast<vtkIdType>(polygon.size()), polygon.data());
 	}
 
 	vtkNew<vtkPolyData> polyData;
@@ -398,8 +456,9 @@ vtkNew<vtkPolyData> mesh_to_vtk(const Mesh& mesh) {
 }
 
 
-void visualize_mesh(Mesh staticMesh, Mesh movableMesh, double& Xoffset, double& Yoffset, double& CutHeight, double& RotZ) {
+void visualize_mesh(const Mesh& staticMesh, const Mesh& movableMesh, double& Xoffset, double& Yoffset, double& CutHeight, double& RotZ) {
 	if (DEBUG) std::cout << Yellow << "      Preparing Mesh Viewer." << ColorEnd << std::endl;
+	init_vtk_modules();
 	CutHeight = 0.0; RotZ = 0.0;
 
 	// Main Renderer setup
@@ -446,6 +505,15 @@ void visualize_mesh(Mesh staticMesh, Mesh movableMesh, double& Xoffset, double&
 	MainRenderer->AddActor(movableActor);
 	InsetRenderer->AddActor(movableActor);
 
+	// Live cut and union preview, built on a worker thread from a decimated model
+	Preview_Worker preview(movableMesh, staticMesh);
+	vtkNew<vtkPolyDataMapper> previewMapper;
+	vtkNew<vtkActor> previewActor;
+	previewActor->SetMapper(previewMapper);
+	previewActor->GetProperty()->SetColor(0.85, 0.85, 0.85);
+	previewActor->VisibilityOff();
+	InsetRenderer->AddActor(previewActor);
+
 
 	// Orientation Marker Widget - SetupCubeWidget(renderWindowInteractor, MainRenderer);
 	vtkNew<vtkAnnotatedCubeActor> cubeActor;
@@ -536,6 +604,7 @@ void visualize_mesh(Mesh staticMesh, Mesh movableMesh, double& Xoffset, double&
 	vtkNew<CutSliderCallback> CutSlidercallback;
 	CutSlidercallback->SetModelActor(movableActor); 
 	CutSlidercallback->SetCutHeightPtr(&CutHeight);
+	CutSlidercallback->SetPreview(&preview);
 	CutSliderWidget->AddObserver(vtkCommand::InteractionEvent, CutSlidercallback);
 
 	// Rotate slider - SetupRotSliderWidget(renderWindowInteractor, movableActor, RotZ, -180, 180, 0);
@@ -563,6 +632,7 @@ void visualize_mesh(Mesh staticMesh, Mesh movableMesh, double& Xoffset, double&
 	vtkNew<RotationSliderCallback> RotSlidercallback;
 	RotSlidercallback->SetRotActor(movableActor);
 	RotSlidercallback->SetRotPtr(&RotZ);
+	RotSlidercallback->SetPreview(&preview);
 	RotSliderWidget->AddObserver(vtkCommand::InteractionEvent, RotSlidercallback);
 
 
@@ -570,6 +640,7 @@ void visualize_mesh(Mesh staticMesh, Mesh movableMesh, double& Xoffset, double&
 	vtkNew<C_InteractorStyle> style;
 	style->SetDefaultRenderer(MainRenderer);
 	style->MeshActor = movableActor;
+	style->Preview = &preview;
 	MainRenderer->AddActor(style->TextActor);
 	renderWindowInteractor->SetInteractorStyle(style);
 	
@@ -591,6 +662,14 @@ void visualize_mesh(Mesh staticMesh, Mesh movableMesh, double& Xoffset, double&
 
 	if (DEBUG) std::cout << Yellow << "      Viewer Started." << ColorEnd << std::endl;
 	renderWindowInteractor->Initialize();
+	vtkNew<PreviewTimerCallback> previewCallback;
+	previewCallback->Preview = &preview;
+	previewCallback->PreviewMapper = previewMapper;
+	previewCallback->PreviewActor = previewActor;
+	previewCallback->ModelActor = movableActor;
+	previewCallback->InsetRenderer = InsetRenderer;
+	renderWindowInteractor->AddObserver(vtkCommand::TimerEvent, previewCallback);
+	renderWindowInteractor->CreateRepeatingTimer(100);
 	renderWindowInteractor->Start();
 	if (DEBUG) std::cout << Yellow << "      Viewer Exited." << ColorEnd << std::endl;
 
@@ -600,8 +679,9 @@ void visualize_mesh(Mesh staticMesh, Mesh movableMesh, double& Xoffset, double&
 	if (DEBUG) std::cout << Yellow << "      Offsets: " << ColorEnd << "X" << Xoffset << ", Y" << Yoffset << std::endl;
 	if (DEBUG) std::cout << "               Z" << CutHeight << ", Rot Z" << RotZ << std::endl;
 }
+#endif // FIXTURE_NO_VTK
 
-bool is_valid_mesh(Mesh mesh) {
+bool is_valid_mesh(const Mesh& mesh) {
 	std::stringstream buffer;
 	std::streambuf* prevcerr = std::cerr.rdbuf(buffer.rdbuf());
 	bool isValid = CGAL::is_valid_polygon_mesh(mesh, DEBUG);
@@ -672,6 +752,7 @@ void clean_difference(Mesh& mesh) {
 }
 
 bool repair_and_validate_mesh(Mesh & mesh) {
+	Stage_Timer timer("repair", &mesh);
 	if (DEBUG) std::cout << Yellow << "      Number of removed vertices: " 
 		<< ColorEnd << PMP::remove_isolated_vertices(mesh) << std::endl;
 	if (DEBUG) std::cout << Yellow << "      Number of new vertices: " 
@@ -679,26 +760,12 @@ bool repair_and_validate_mesh(Mesh & mesh) {
 	if (DEBUG) std::cout << Yellow << "      Number of stitches: " 
 		<< ColorEnd << PMP::stitch_borders(mesh) << std::endl;
 	mesh.collect_garbage();
+	if (DEBUG) std::cout << Yellow << "      Self-intersecting: " << ColorEnd
+		<< with_fixture_threads([&] { return PMP::does_self_intersect<Concurrency_Tag>(mesh); }) << std::endl;
 	return is_valid_mesh(mesh);
 }
 
-void get_dimensions(Mesh mesh, double& modelWidth, double& modelLength, double& modelHeight) {
-	std::vector<Point> points;
-	for (auto v : mesh.vertices()) {
-		points.push_back(mesh.point(v));
-	}
-	Kernel::Iso_cuboid_3 bbox = CGAL::bounding_box(points.begin(), points.end());
-	modelWidth = static_cast<double>(bbox.xmax() - bbox.xmin());
-	modelLength = static_cast<double>(bbox.ymax() - bbox.ymin());
-	modelHeight = static_cast<double>(bbox.zmax() - bbox.zmin());
-	if (DEBUG) std::cout << Yellow << "      Dimensions:" << ColorEnd
-		<< "  (W"
-		<< modelWidth << "  L" 
-		<< modelLength << "  H" 
-		<< modelHeight << ")" << std::endl;
-}
-
-void get_center(Mesh mesh, Point& center) {
+void get_center(const Mesh& mesh, Point& center) {
 	CGAL::Bbox_3 bbox;
 	for (auto v : mesh.vertices()) {
 		bbox += mesh.point(v).bbox();
@@ -711,7 +778,7 @@ void get_center(Mesh mesh, Point& center) {
 		<< center.z() << ")" << std::endl;
 }
 
-void get_centroid(Mesh mesh, Point& centroid) {
+void get_centroid(const Mesh& mesh, Point& centroid) {
 	std::vector<Point> vertices;
 	for (auto v : mesh.vertices()) {
 		vertices.push_back(mesh.point(v));
@@ -724,94 +791,12 @@ void get_centroid(Mesh mesh, Point& centroid) {
 		<< centroid.z() << ")" << std::endl;
 }
 
-void settle_mesh_z0(Mesh& mesh) {
-	double min_z = std::numeric_limits<double>::infinity();
-	for (auto v : mesh.vertices()) {
-		double z = mesh.point(v).z();
-		if (z < min_z) min_z = z;
-	}
-	if (DEBUG) std::cout << Yellow << "      Settling mesh at Z:  " << ColorEnd << -min_z << std::endl;
-
-	Kernel::Vector_3 translation_vector(0, 0, -min_z);
-	for (auto v : mesh.vertices()) {
-		Point p = mesh.point(v) + translation_vector;
-		mesh.point(v) = p;
-	}
-}
-
-void cut_mesh(Mesh& mesh, double model_height, double max_height) {
-	double size = 100.0, height = model_height - max_height , bottom_z = -10;
-	if (height >= 0) {
-		Mesh clipper, Result_Mesh;
-		Vertex_index v0 = clipper.add_vertex(Point(-size, -size, height));
-		Vertex_index v1 = clipper.add_vertex(Point(size, -size, height));
-		Vertex_index v2 = clipper.add_vertex(Point(size, size, height));
-		Vertex_index v3 = clipper.add_vertex(Point(-size, size, height));
-		Vertex_index v4 = clipper.add_vertex(Point(-size, -size, bottom_z));
-		Vertex_index v5 = clipper.add_vertex(Point(size, -size, bottom_z));
-		Vertex_index v6 = clipper.add_vertex(Point(size, size, bottom_z));
-		Vertex_index v7 = clipper.add_vertex(Point(-size, size, bottom_z));
-		// Top face
-		clipper.add_face(v0, v1, v2);
-		clipper.add_face(v2, v3, v0);
-		// Bottom face
-		clipper.add_face(v4, v6, v5);
-		clipper.add_face(v6, v4, v7);
-		// Four side faces
-		clipper.add_face(v0, v4, v1);
-		clipper.add_face(v1, v4, v5);
-		clipper.add_face(v1, v5, v2);
-		clipper.add_face(v2, v5, v6);
-		clipper.add_face(v2, v6, v3);
-		clipper.add_face(v3, v6, v7);
-		clipper.add_face(v3, v7, v0);
-		clipper.add_face(v0, v7, v4);
-
-		if (DEBUG) std::cout << Yellow << "      Cutting mesh at Z:  " << ColorEnd << height << std::endl;
-		if (!PMP::corefine_and_compute_difference(mesh, clipper, Result_Mesh)) {
-			std::cerr << Red << "      Cutting mesh failed." << ColorEnd << std::endl;
-		}
-		settle_mesh_z0(Result_Mesh);
-		mesh.clear();
-		mesh = Result_Mesh;
-	}
-	else {
-		if (DEBUG) std::cout << Yellow << "      No Cutting mesh needed:  " << ColorEnd << height << std::endl;
-	}
-}
-
 void extrude_bottom_faces(Mesh& mesh, double target_z) {
 	double z_threshold = 0.1;
 	if (DEBUG) std::cout << Yellow << "      Extruding mesh :  " << ColorEnd << target_z << std::endl;
 	for (Vertex_index v : mesh.vertices()) {
-		Point& p = mesh.point(v);
-		if (p.z() >= z_threshold) {
-			mesh.point(v) = Point(p.x(), p.y(), p.z() - target_z);
-		}
-	}
-}
-
-void scaleMesh(Mesh& mesh, double XYscale, double XYtopscale, double Zscale, double zThreshold) {
-	for (auto v : mesh.vertices()) {
-		Point& point = mesh.point(v);
-		double new_x, new_y, new_z;
-
-		if (point.z() > zThreshold) {
-			new_x = point.x() * XYtopscale;
-			new_y = point.y() * XYtopscale;
-		} else {
-			new_x = point.x() * XYscale;
-			new_y = point.y() * XYscale;
-		}
-		new_z = point.z() * Zscale;
-		mesh.point(v) = Point(new_x, new_y, new_z);
-	}
-}
-
-void translate_mesh(Mesh& mesh, const Vector& translation_vector) {
-	if (DEBUG) std::cout << Yellow << "      Applying translation:  " << ColorEnd << translation_vector << std::endl;
-	for (auto v : mesh.vertices()) {
-		mesh.point(v) = mesh.point(v) + translation_vector;
+		const Point& p = mesh.point(v);
+		if (p.z() >= z_threshold) mesh.point(v) = Point(p.x(), p.y(), p.z() - target_z);
 	}
 }
 
@@ -831,81 +816,221 @@ void rotate_mesh(Mesh& mesh, double x_deg, double y_deg, double z_deg) {
 	PMP::transform(combined, mesh);
 }
 
-bool read_STL(const std::string& filename, Mesh& mesh) {
-	mesh.clear();
-	fs::path filepath(filename);
-	if (DEBUG) std::cout << Yellow << "      Reading STL file:  " << ColorEnd << filepath.filename() << std::endl;
-	if (!PMP::IO::read_polygon_mesh(filename, mesh)) {
-		std::cerr << Red << "Error: Cannot read the STL file:  " << ColorEnd << filepath.filename() << std::endl;
-		return false;
-	}
-	return true;
+// Centers the model in XY over the fixture tag, the start position of the viewer.
+void center_model(Mesh& Model_Mesh) {
+	Point center;
+	get_center(Model_Mesh, center);
+	translate_mesh(Model_Mesh, Kernel::Vector_3(-center.x(), -center.y() + 6, 0));
 }
 
-bool write_STL(const std::string& filename, const Mesh& mesh) {
-	fs::path filepath(filename);
-	if (DEBUG) std::cout << Yellow << "      Writting STL file:  " << ColorEnd << filepath.filename() << std::endl;
-	if (!CGAL::IO::write_polygon_mesh(filename, mesh, CGAL::parameters::stream_precision(10))) {
-		std::cerr << Red << "Error: Cannot write the STL file:  " << ColorEnd << filepath.filename() << std::endl;
-		return false;
-	}
+struct BatchItem {
+	size_t line = 0;
+	std::string id, output, model;
+};
+
+std::string trim(const std::string& str) {
+	size_t first = str.find_first_not_of(" \t\r");
+	if (first == std::string::npos) return "";
+	size_t last = str.find_last_not_of(" \t\r");
+	return str.substr(first, last - first + 1);
+}
+
+// Parses "id,output[,model]". Blank lines and lines starting with '#' are skipped.
+bool parse_batch_line(const std::string& line, BatchItem& item) {
+	std::vector<std::string> fields;
+	std::stringstream ss(line);
+	std::string field;
+	while (std::getline(ss, field, ',')) fields.push_back(trim(field));
+	if (fields.size() < 2 || fields.size() > 3 || fields[0].empty() || fields[1].empty()) return false;
+	item.id = fields[0];
+	item.output = fields[1];
+	item.model = fields.size() == 3 ? fields[2] : "";
 	return true;
 }
 
+// Command line choices that apply to every fixture a run builds.
+struct Build_Options {
+	Fixture_Base_Params base;
+	bool lowMemory = false;
+	bool decimate = false;
+	Decimation_Settings decimation;
+	Plate_Settings plates; // batch only: nest the items instead of writing their outputs
+};
 
-bool read_STL_data(const std::string& identifier, Mesh& mesh) {
-	mesh.clear();
-	for (const auto& data : FONT_STL) {
-		if (data.key == identifier) { // Convert char to string for comparison
-			if (DEBUG) std::cout << Yellow << "      Reading STL Data:  " << ColorEnd << identifier << std::endl;
-			std::istringstream iss(std::string(reinterpret_cast<const char*>(data.data), data.size), std::ios::binary);
-			if (CGAL::IO::read_STL(iss, mesh)) { // Ensure this matches the actual function available in CGAL
-				return true;
-			}
-			break;
-		}
+// Applies the decimation flags to the model and unions it with the tag mesh
+// into Result_Mesh. False when the result cannot be written as requested.
+bool merge_with_options(Mesh& Model_Mesh, Mesh& Fixture_Tag_Mesh, Mesh& Result_Mesh, const Build_Options& options) {
+	if (options.decimate) decimate_outside_fixture(Model_Mesh, Fixture_Tag_Mesh, options.decimation);
+
+	if (options.lowMemory) {
+		bool ok = merge_model_in_place(Model_Mesh, Fixture_Tag_Mesh);
+		std::swap(Result_Mesh, Model_Mesh);
+		return ok;
 	}
-	std::cerr << Red << "      Error: No STL data available for:  " << ColorEnd << identifier << std::endl;
-	return false;
+	return merge_model(Model_Mesh, Fixture_Tag_Mesh, Result_Mesh);
 }
 
-void create_fixture(std::string ID_Str, Mesh Fixture_Mesh, Mesh& Result_Mesh) {
-	bool lastWasDigit = false;
-	double offsetX = -6.5, offsetY = -7.5, offsetZ = 4.0;
-	double XYscale = 0.18, XYtopscale = 0.18, Zscale = 0.30;
-	double zThreshold = 0.1;
-	double Xspacing = 0.8, Yspacing = 2.9;
-	double zDepth = -1.0;
-	Mesh Tag_Mesh;
+bool build_batch_item(const BatchItem& item, const TagLayout& layout, const Build_Options& options, Mesh& Result_Mesh) {
+	Mesh Fixture_Mesh;
+	if (!load_fixture_base(options.base, Fixture_Mesh)) return false;
 
-	std::transform(ID_Str.begin(), ID_Str.end(), ID_Str.begin(), [](unsigned char c) { return std::toupper(c); });
+	if (!create_fixture(item.id, std::move(Fixture_Mesh), Result_Mesh, layout)) return false;
 
-	for (char c : ID_Str) {
-		Mesh Letter_Mesh;
-		double FontWidth = 0.0, FontLength = 0.0, FontHeight = 0.0;
+	if (!item.model.empty()) {
+		Mesh Model_Mesh, Fixture_Tag_Mesh;
+		if (!read_STL(item.model, Model_Mesh)) return false;
+		std::swap(Fixture_Tag_Mesh, Result_Mesh);
+		center_model(Model_Mesh);
+		return merge_with_options(Model_Mesh, Fixture_Tag_Mesh, Result_Mesh, options);
+	}
+	return true;
+}
 
-		if (!read_STL_data(std::string(1, c), Letter_Mesh)) continue;
+// Runs every line of the list file (or stdin for "-") through the same process,
+// so the fixture and glyph meshes are decoded once and shared by all workers.
+// Items are queued on the shared workers as they are read and one status line
+// is printed per item once its file is written by the output stage.
+bool run_batch(const std::string& listPath, const TagLayout& layout, const Build_Options& options) {
+	std::ifstream listFile;
+	if (listPath != "-") {
+		listFile.open(listPath);
+		if (!listFile) {
+			std::cerr << Red << "      Error: Cannot open batch list:  " << ColorEnd << listPath << std::endl;
+			return false;
+		}
+	}
+	std::istream& input = listPath == "-" ? std::cin : listFile;
 
-		get_dimensions(Letter_Mesh, FontWidth, FontLength, FontHeight);
+	std::mutex printMutex;
+	std::atomic<int> succeeded{ 0 }, failed{ 0 };
+	auto start = std::chrono::high_resolution_clock::now();
 
-		if (std::isdigit(c)) {
-			lastWasDigit = true;
-		} else if (lastWasDigit) {
-			offsetY -= (FontLength * XYscale) + Yspacing;
-			offsetX = -6.35; // 0.15
-			lastWasDigit = false;
+	std::unique_ptr<Plate_Nester> nester;
+	if (options.plates.enabled) nester = std::make_unique<Plate_Nester>(options.plates);
+	{
+		// Declared before the batch so items never outlive the writer they hand off to.
+		Output_Writer writer(2, 2 * fixture_threads());
+		Task_Batch items;
+		std::cout << Yellow << "      Batch workers: " << ColorEnd << items.size() << std::endl;
+
+		std::string line;
+		size_t lineNumber = 0;
+		while (std::getline(input, line)) {
+			++lineNumber;
+			line = trim(line);
+			if (line.empty() || line[0] == '#') continue;
+
+			BatchItem item;
+			item.line = lineNumber;
+			if (!parse_batch_line(line, item)) {
+				std::lock_guard<std::mutex> lock(printMutex);
+				std::cerr << Red << "      [FAIL] " << ColorEnd << "line " << lineNumber << ": expected id,output[,model]" << std::endl;
+				failed++;
+				continue;
+			}
+
+			items.run([item, &layout, &options, &writer, &nester, &printMutex, &succeeded, &failed] {
+				auto itemStart = std::chrono::high_resolution_clock::now();
+				auto report = [item, itemStart, &printMutex, &succeeded, &failed](bool ok) {
+					std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - itemStart;
+					std::ostringstream seconds;
+					seconds << std::fixed << std::setprecision(2) << elapsed.count();
+
+					std::lock_guard<std::mutex> lock(printMutex);
+					if (ok) {
+						succeeded++;
+						std::cout << Green << "      [ OK ] " << ColorEnd;
+					}
+					else {
+						failed++;
+						std::cout << Red << "      [FAIL] " << ColorEnd;
+					}
+					std::cout << item.id << " -> " << item.output << "  (" << seconds.str() << " s)" << std::endl;
+				};
+
+				Mesh Result_Mesh;
+				bool ok = false;
+				Stage_Stats::instance().begin_fixture(item.id);
+				try {
+					ok = build_batch_item(item, layout, options, Result_Mesh);
+				}
+				catch (const std::exception& e) {
+					std::lock_guard<std::mutex> lock(printMutex);
+					std::cerr << Red << "      Exception: " << ColorEnd << e.what() << std::endl;
+				}
+				if (ok && nester) writer.write([&nester, item](Mesh& mesh) { return nester->add(item.id, std::move(mesh)); }, std::move(Result_Mesh), report);
+				else if (ok) writer.write(item.output, std::move(Result_Mesh), report);
+				else report(false);
+				Stage_Stats::instance().end_fixture(); // no-op once the writer has taken the fixture
+			});
 		}
+		items.wait();
+		writer.flush();
+	}
+	if (nester) {
+		// Plates are named after the list file, or "batch" for stdin
+		std::string prefix = listPath == "-" ? std::string("batch") : fs::path(listPath).replace_extension().string();
+		int nested = nester->write_plates(prefix, false);
+		failed += succeeded - nested;
+		succeeded = nested;
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	std::cout << "\n      " << Green << succeeded.load() << ColorEnd << " fixtures created, ";
+	if (failed) std::cout << Red;
+	std::cout << failed.load() << ColorEnd << " failed" << std::endl;
+	std::cout << Yellow << "      Elapsed time: " << elapsed.count() << " seconds" << ColorEnd << std::endl;
+	Stage_Stats::instance().summary(std::cout);
+	return failed == 0;
+}
 
-		scaleMesh(Letter_Mesh, XYscale, XYtopscale, Zscale, zThreshold);
-		translate_mesh(Letter_Mesh, Kernel::Vector_3(offsetX, offsetY, offsetZ + zDepth));
-		offsetX += (FontWidth * XYscale) + Xspacing;
-		CGAL::copy_face_graph(Letter_Mesh, Tag_Mesh);
+// Keeps the process alive with every glyph and the fixture decoded and serves
+// batch-format request lines over a local socket. An output of "-" returns the
+// STL bytes in the response instead of writing a file. Requests run on the
+// shared workers, at most FIXTURE_THREADS at a time.
+bool run_server(const std::string& socketPath, const TagLayout& layout, const Build_Options& options) {
+	Mesh Warm_Mesh;
+	if (!load_fixture_base(options.base, Warm_Mesh)) return false;
+	Warm_Mesh.clear();
+	for (const auto& data : FONT_STL) {
+		if (data.key[0] != '\0' && data.key[1] == '\0') Glyph_Font::active().glyph(data.key[0]);
 	}
 
-	Result_Mesh.clear();
-	if (!PMP::corefine_and_compute_difference(Fixture_Mesh, Tag_Mesh, Result_Mesh)) {
-		std::cerr << Red << "      Subtraction operation failed." << ColorEnd << std::endl;
+	Fixture_Server server(socketPath,
+		[&layout, &options](const std::string& request, std::string& payload, std::string& error) {
+			BatchItem item;
+			if (!parse_batch_line(trim(request), item)) {
+				error = "expected id,output[,model]";
+				return false;
+			}
+			Mesh Result_Mesh;
+			Stage_Stats::instance().begin_fixture(item.id);
+			bool ok = build_batch_item(item, layout, options, Result_Mesh);
+			if (!ok) error = "cannot create fixture " + item.id;
+			else if (item.output == "-") ok = write_STL_buffer(Result_Mesh, payload);
+			else if (!(ok = write_STL(item.output, Result_Mesh))) error = "cannot write " + item.output;
+			Stage_Stats::instance().end_fixture();
+			return ok;
+		});
+	bool ok = server.run();
+	Stage_Stats::instance().summary(std::cout);
+	return ok;
+}
+
+// Test client: sends one request line and saves returned STL bytes to outputPath.
+bool run_client(const std::string& socketPath, const std::string& request, const std::string& outputPath) {
+	std::string status, payload;
+	if (!fixture_request(socketPath, request, status, payload)) return false;
+	std::cout << status << std::endl;
+	if (!payload.empty() && !outputPath.empty()) {
+		std::ofstream out(outputPath, std::ios::binary);
+		out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+		if (!out) {
+			std::cerr << Red << "Error: Cannot write the STL file:  " << ColorEnd << outputPath << std::endl;
+			return false;
+		}
 	}
+	return status.rfind("OK", 0) == 0 || status.rfind("STATS", 0) == 0;
 }
 
 int main(int argc, char* argv[]) {
@@ -914,11 +1039,16 @@ int main(int argc, char* argv[]) {
 
 
 	std::map<std::string, std::string> args;
+	Build_Options options;
 	for (int i = 1; i < argc; ++i) {
 		if (std::string(argv[i]) == "-DB") {
 			DEBUG = true;
 			continue;
 		}
+		if (std::string(argv[i]) == "-LM") {
+			options.lowMemory = true;
+			continue;
+		}
 		if (i + 1 < argc) {
 			args[argv[i]] = argv[i + 1];
 			i++;
@@ -929,10 +1059,62 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
+	TagLayout layout;
+	layout.zDepth = -1.0;
+	layout.center = args.count("-TC") && std::atoi(args["-TC"].c_str()) != 0;
+	if (args.count("-TF")) layout.fitToPlate = std::atoi(args["-TF"].c_str()) != 0;
+	if (args.count("-TM")) layout.minScale = std::atof(args["-TM"].c_str());
+
+	if (args.count("-NEST") && !options.plates.parse(args["-NEST"])) {
+		std::cerr << Red << "      Invalid build plate: " << ColorEnd << args["-NEST"] << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (args.count("-WT")) COMPACT_TOLERANCE = std::max(0.0, std::atof(args["-WT"].c_str()));
+	CANONICAL_OUTPUT = args.count("-CO") && std::atoi(args["-CO"].c_str()) != 0;
+
+	if (args.find("-ST") != args.end() && !Stage_Stats::instance().open(args["-ST"])) return EXIT_FAILURE;
+
+	if (args.count("-FONT") && !Glyph_Font::active().load(args["-FONT"])) return EXIT_FAILURE;
+	if (args.count("-FB") && !options.base.parse(args["-FB"])) {
+		std::cerr << Red << "      Invalid fixture base size: " << ColorEnd << args["-FB"] << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!options.base.place_tag(layout)) {
+		std::cerr << Red << "      The fixture base cannot hold the tag: " << ColorEnd << args["-FB"] << std::endl;
+		return EXIT_FAILURE;
+	}
+	options.decimate = args.count("-DR") || args.count("-RE") || args.count("-RD");
+	if (args.count("-RD")) options.decimation.keepDistance = std::atof(args["-RD"].c_str());
+	if (args.count("-RE")) options.decimation.maxError = std::atof(args["-RE"].c_str());
+	if (args.count("-DR")) options.decimation.minRatio = std::atof(args["-DR"].c_str());
+
+	if (args.count("--threads")) args["-T"] = args["--threads"];
+	if (args.count("-T")) FIXTURE_THREADS = static_cast<unsigned>(std::max(0, std::atoi(args["-T"].c_str())));
+	if (args.find("-B") != args.end()) {
+		return run_batch(args["-B"], layout, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (args.find("-S") != args.end()) {
+		return run_server(args["-S"], layout, options) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (args.find("-C") != args.end() && args.find("-Q") != args.end()) {
+		return run_client(args["-C"], args["-Q"], args["-O"]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	if (args.find("-O") == args.end() || args.find("-N") == args.end()) {
 		std::cerr << Yellow << "Usage: OCR_FIXTURE_TOOL.exe -O out.stl -N id [-I model.stl]" << ColorEnd << std::endl;
+		std::cerr << Yellow << "       OCR_FIXTURE_TOOL.exe -B list.txt|-   (lines: id,output[,model])" << ColorEnd << std::endl;
+		std::cerr << Yellow << "                             [-NEST width,length[,spacing]] nest the batch onto list_plateN.stl" << ColorEnd << std::endl;
+		std::cerr << Yellow << "       OCR_FIXTURE_TOOL.exe -S socket" << ColorEnd << std::endl;
+		std::cerr << Yellow << "       common: [-DB] [-T|--threads n] worker threads, 0 every core [-ST stats.jsonl] [-FB width,length,height] block base instead of the standard fixture" << ColorEnd << std::endl;
+		std::cerr << Yellow << "       tag text: [-FONT outlines.txt] [-TC 1] center on the plate [-TF 1] fit long IDs instead of rejecting them [-TM min_scale]" << ColorEnd << std::endl;
+		std::cerr << Yellow << "       OCR_FIXTURE_TOOL.exe -C socket -Q \"id,output|-[,model]\"|STATS|SHUTDOWN [-O out.stl]" << ColorEnd << std::endl;
+		std::cerr << Yellow << "       model placement without the viewer: [-X mm] [-Y mm] [-RZ deg] [-CH cut_height]" << ColorEnd << std::endl;
+		std::cerr << Yellow << "       large scans: [-LM] low-memory merge" << ColorEnd << std::endl;
+		std::cerr << Yellow << "       output cleanup: [-WT weld_mm] vertex weld tolerance, 0 only drops removed elements" << ColorEnd << std::endl;
+		std::cerr << Yellow << "                       [-CO 1] canonical vertex and face order, same geometry gives the same STL bytes" << ColorEnd << std::endl;
+		std::cerr << Yellow << "       decimate the model away from the fixture: [-RD keep_mm] [-RE max_error_mm] [-DR min_ratio]" << ColorEnd << std::endl;
 		
-		std::cin.get();  // Waits for the user to press Enter
+		if (console_attached()) std::cin.get();  // Waits for the user to press Enter
 		return EXIT_FAILURE;
 	}
 
@@ -941,25 +1123,43 @@ int main(int argc, char* argv[]) {
 		, Model_Path_Str = args["-I"];
 	Mesh Fixture_Mesh, Model_Mesh, Result_Mesh;
 
+	// Checked before the model is read or any geometry is built
+	if (!tag_fits(ID_Str, layout)) return EXIT_FAILURE;
+
 	
-	if (!read_STL_data("fixture", Fixture_Mesh)) return EXIT_FAILURE;
+	if (!load_fixture_base(options.base, Fixture_Mesh)) return EXIT_FAILURE;
 
-	create_fixture(ID_Str, Fixture_Mesh, Result_Mesh);
+	Stage_Stats::instance().begin_fixture(ID_Str);
+	if (!create_fixture(ID_Str, std::move(Fixture_Mesh), Result_Mesh, layout)) return EXIT_FAILURE;
 
 
 	if (!Model_Path_Str.empty()) {
 		if (!read_STL(Model_Path_Str, Model_Mesh)) return EXIT_FAILURE;
 
 		double Width, Length, Height, Model_Xoffset, Model_Yoffset, cut_height, Model_Zrot;
-		Mesh Fixture_Tag_Mesh = Result_Mesh;
+		Mesh Fixture_Tag_Mesh;
 		Point centroid, center;
-		Result_Mesh.clear();
+		std::swap(Fixture_Tag_Mesh, Result_Mesh);
 		
 		get_dimensions(Model_Mesh, Width, Length, Height);
-		get_center(Model_Mesh, center);
-		translate_mesh(Model_Mesh, Kernel::Vector_3(-center.x(), -center.y() + 6, 0));
-
-		visualize_mesh(Fixture_Tag_Mesh, Model_Mesh , Model_Xoffset, Model_Yoffset, cut_height, Model_Zrot);
+		center_model(Model_Mesh);
+
+		// Any placement flag skips the viewer; builds without VTK always take it from the flags.
+		bool placed = args.count("-X") || args.count("-Y") || args.count("-RZ") || args.count("-CH");
+#ifdef FIXTURE_NO_VTK
+		placed = true;
+#endif
+		if (placed) {
+			Model_Xoffset = args.count("-X") ? std::atof(args["-X"].c_str()) : 0.0;
+			Model_Yoffset = args.count("-Y") ? std::atof(args["-Y"].c_str()) : 0.0;
+			Model_Zrot = args.count("-RZ") ? std::atof(args["-RZ"].c_str()) : 0.0;
+			cut_height = args.count("-CH") ? std::atof(args["-CH"].c_str()) : 0.0;
+		}
+#ifndef FIXTURE_NO_VTK
+		else {
+			visualize_mesh(Fixture_Tag_Mesh, Model_Mesh , Model_Xoffset, Model_Yoffset, cut_height, Model_Zrot);
+		}
+#endif
 
 		if (Model_Xoffset != NULL || Model_Yoffset != NULL)
 			translate_mesh(Model_Mesh, Kernel::Vector_3(Model_Xoffset, Model_Yoffset, 0));
@@ -968,13 +1168,8 @@ int main(int argc, char* argv[]) {
 		if (cut_height >= 0.1) {
 			cut_mesh(Model_Mesh, cut_height, 0);
 		}
-		
-		if (!PMP::corefine_and_compute_union(Model_Mesh, Fixture_Tag_Mesh, Result_Mesh)) {
-		    std::cerr << Red << "      Model Addition failed." << ColorEnd << std::endl;
-			Result_Mesh.clear();
-			CGAL::copy_face_graph(Fixture_Tag_Mesh, Result_Mesh);
-			CGAL::copy_face_graph(Model_Mesh, Result_Mesh);
-		}
+
+		if (!merge_with_options(Model_Mesh, Fixture_Tag_Mesh, Result_Mesh, options)) return EXIT_FAILURE;
 	}
 
 	//if (repair_and_validate_mesh(Result_Mesh)) {
@@ -985,8 +1180,13 @@ int main(int argc, char* argv[]) {
 	//}
 	
 	if (!write_STL(Output_Path_Str, Result_Mesh)) return EXIT_FAILURE;
+	Stage_Stats::instance().end_fixture();
+	Stage_Stats::instance().summary(std::cout);
 
 	std::cout << Green << "      Operation completed successfully." << ColorEnd << std::endl;
+	if (options.lowMemory || DEBUG) {
+		std::cout << Yellow << "      Peak memory: " << ColorEnd << peak_rss_bytes() / (1024 * 1024) << " MB" << std::endl;
+	}
 
 	//std::cout << "      Press enter to continue...";
 	//std::cin.get();  // Waits for the user to press Enter
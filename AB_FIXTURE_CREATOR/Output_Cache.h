@@ -0,0 +1,202 @@
+#ifndef OUTPUT_CACHE_H
+#define OUTPUT_CACHE_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "Fixture_Mesh.h"
+#include "Fixture_Base.h"
+
+#include <CGAL/IO/STL.h>
+
+// Bump whenever create_fixture changes its output for the same inputs.
+const char* const OUTPUT_CACHE_VERSION = "fixture-v7";
+
+inline void fnv1a(uint64_t& hash, const void* data, size_t size) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+}
+
+inline bool hash_STL_data(uint64_t& hash, const std::string& identifier) {
+	const STLData* data = find_STL_data(identifier.c_str());
+	if (!data) return false;
+	fnv1a(hash, data->data, data->size);
+	return true;
+}
+
+// The fixture STL is a pure function of the ID text, the tag layout, the base
+// (embedded fixture data or its parameters) and the glyphs (embedded data or
+// the font file), so those are all that goes into the key.
+inline std::string fixture_cache_key(std::string ID_Str, const TagLayout& layout, const Fixture_Base_Params& base = Fixture_Base_Params()) {
+	std::transform(ID_Str.begin(), ID_Str.end(), ID_Str.begin(), [](unsigned char c) { return std::toupper(c); });
+
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	fnv1a(hash, OUTPUT_CACHE_VERSION, std::char_traits<char>::length(OUTPUT_CACHE_VERSION));
+	fnv1a(hash, ID_Str.data(), ID_Str.size());
+	const double fields[] = { layout.offsetX, layout.offsetY, layout.offsetZ, layout.XYscale, layout.XYtopscale,
+		layout.Zscale, layout.zThreshold, layout.Xspacing, layout.Yspacing, layout.lineStartX, layout.zDepth,
+		layout.plateMinX, layout.plateMaxX, layout.plateMinY, layout.plateMaxY,
+		layout.center ? 1.0 : 0.0, layout.fitToPlate ? 1.0 : 0.0, layout.minScale, static_cast<double>(layout.maxLines),
+		COMPACT_TOLERANCE, CANONICAL_OUTPUT ? 1.0 : 0.0 };
+	fnv1a(hash, fields, sizeof(fields));
+	if (base.parametric) {
+		const double baseFields[] = { base.width, base.length, base.height, base.centerX, base.centerY,
+			base.tagMinX, base.tagMaxX, base.tagMinY, base.tagMaxY, base.tagCell };
+		fnv1a(hash, baseFields, sizeof(baseFields));
+	}
+	else {
+		hash_STL_data(hash, "fixture");
+	}
+	const std::string& font = Glyph_Font::active().source();
+	if (!font.empty()) {
+		fnv1a(hash, font.data(), font.size());
+	}
+	else {
+		for (char c : ID_Str) hash_STL_data(hash, std::string(1, c));
+	}
+
+	char hex[17];
+	std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+	return hex;
+}
+
+// Content-addressed store of finished fixture STLs. Hits are copied into the
+// output directory, never linked, so the delivered file and the entry stay
+// separate files: refreshing the entry's timestamp, which lets eviction drop
+// the least recently used files once the directory grows past maxBytes, or
+// evicting it never touches an output, and editing an output never changes
+// the cache.
+class Output_Cache {
+public:
+	Output_Cache(const fs::path& directory, uintmax_t maxBytes) : directory(directory), maxBytes(maxBytes) {
+		std::error_code ec;
+		if (maxBytes > 0) fs::create_directories(directory, ec);
+		enabled = maxBytes > 0 && !ec;
+	}
+
+	bool fetch(const std::string& key, const fs::path& target) {
+		if (!enabled) return false;
+		fs::path entry = entry_path(key);
+		std::error_code ec;
+		if (!fs::exists(entry, ec)) {
+			misses++;
+			return false;
+		}
+		fs::path temp = target;
+		temp += ".tmp" + std::to_string(++tempCounter);
+		fs::copy_file(entry, temp, fs::copy_options::overwrite_existing, ec);
+		if (!ec) fs::rename(temp, target, ec);
+		if (ec) {
+			fs::remove(temp, ec);
+			misses++;
+			return false;
+		}
+		fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+		hits++;
+		return true;
+	}
+
+	// fetch() for callers that want the mesh rather than a file.
+	bool fetch_mesh(const std::string& key, Mesh& mesh) {
+		if (!enabled) return false;
+		fs::path entry = entry_path(key);
+		std::error_code ec;
+		if (!fs::exists(entry, ec) || !read_STL(entry.string(), mesh)) {
+			misses++;
+			return false;
+		}
+		fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+		hits++;
+		return true;
+	}
+
+	// store() for meshes that never had a file of their own.
+	void store_mesh(const std::string& key, const Mesh& mesh) {
+		if (!enabled) return;
+		fs::path entry = entry_path(key);
+		fs::path temp = entry;
+		temp += ".tmp" + std::to_string(++tempCounter);
+		bool ok;
+		{
+			std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+			ok = out && CGAL::IO::write_STL(out, mesh, CGAL::parameters::stream_precision(10));
+			out.close();
+			ok = ok && !out.fail();
+		}
+		std::error_code ec;
+		if (ok) fs::rename(temp, entry, ec);
+		if (!ok || ec) {
+			fs::remove(temp, ec);
+			if (DEBUG) std::cout << Yellow << "      Cache store failed:  " << ColorEnd << key << std::endl;
+		}
+	}
+
+	void store(const std::string& key, const fs::path& source) {
+		if (!enabled) return;
+		fs::path entry = entry_path(key);
+		fs::path temp = entry;
+		temp += ".tmp" + std::to_string(++tempCounter);
+		std::error_code ec;
+		fs::copy_file(source, temp, fs::copy_options::overwrite_existing, ec);
+		if (!ec) fs::rename(temp, entry, ec);
+		if (ec) {
+			fs::remove(temp, ec);
+			if (DEBUG) std::cout << Yellow << "      Cache store failed:  " << ColorEnd << key << std::endl;
+		}
+	}
+
+	// Removes the least recently used entries until the cache fits maxBytes.
+	void evict() {
+		if (!enabled) return;
+		std::lock_guard<std::mutex> lock(evictMutex);
+		struct Entry { fs::path path; fs::file_time_type time; uintmax_t size; };
+		std::vector<Entry> entries;
+		uintmax_t total = 0;
+		std::error_code ec;
+		for (const auto& item : fs::directory_iterator(directory, ec)) {
+			if (!item.is_regular_file(ec) || item.path().extension() != ".stl") continue;
+			Entry e{ item.path(), item.last_write_time(ec), item.file_size(ec) };
+			total += e.size;
+			entries.push_back(e);
+		}
+		if (total <= maxBytes) return;
+
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+		for (const Entry& e : entries) {
+			if (total <= maxBytes) break;
+			if (fs::remove(e.path, ec)) {
+				total -= e.size;
+				evicted++;
+			}
+		}
+	}
+
+	bool is_enabled() const { return enabled; }
+	int hit_count() const { return hits; }
+	int miss_count() const { return misses; }
+	int evicted_count() const { return evicted; }
+
+private:
+	fs::path entry_path(const std::string& key) const { return directory / (key + ".stl"); }
+
+	fs::path directory;
+	uintmax_t maxBytes;
+	bool enabled = false;
+	std::atomic<int> hits{ 0 }, misses{ 0 }, evicted{ 0 }, tempCounter{ 0 };
+	std::mutex evictMutex;
+};
+
+#endif // OUTPUT_CACHE_H
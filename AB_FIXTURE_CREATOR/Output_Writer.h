@@ -0,0 +1,168 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "Stage_Stats.h"
+
+#include <CGAL/IO/STL.h>
+
+// Write-behind stage for finished meshes. Geometry workers move their result
+// in and go back to computing; dedicated I/O threads write each file to a
+// temporary next to the target and rename it into place, so readers never
+// see a half-written STL. write() blocks while `capacity` meshes are already
+// waiting, which bounds the memory held by a slow output share. A fixture
+// open in Stage_Stats on the calling thread goes along with its mesh: the
+// write is timed as its "write" stage and the fixture ends after it.
+//
+//   Output_Writer writer(2, 8);
+//   writer.write(path, std::move(Result_Mesh), [](bool ok) { ... });
+//   writer.flush();   // all queued files are on disk (or failed)
+//
+// The callback runs on an I/O thread and must not throw.
+class Output_Writer {
+public:
+	typedef std::function<void(bool ok)> Done;
+	// Writes the mesh somewhere other than its own file, e.g. into a Case_Archive.
+	typedef std::function<bool(Mesh& mesh)> Sink;
+
+	explicit Output_Writer(unsigned threads = 2, size_t capacity = 8) : capacity(std::max<size_t>(1, capacity)) {
+		threads = std::max(1u, threads);
+		for (unsigned i = 0; i < threads; ++i) {
+			writers.emplace_back([this] { worker(); });
+		}
+	}
+
+	~Output_Writer() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+		}
+		jobReady.notify_all();
+		for (auto& t : writers) t.join();
+	}
+
+	Output_Writer(const Output_Writer&) = delete;
+	Output_Writer& operator=(const Output_Writer&) = delete;
+
+	void write(const std::string& path, Mesh&& mesh, Done done = nullptr) {
+		enqueue(Job{ path, nullptr, std::move(mesh), std::move(done) });
+	}
+
+	// Same queue and threads, but the mesh goes to sink instead of an STL file.
+	void write(Sink sink, Mesh&& mesh, Done done = nullptr) {
+		enqueue(Job{ std::string(), std::move(sink), std::move(mesh), std::move(done) });
+	}
+
+	// Blocks until every queued file has been written.
+	void flush() {
+		std::unique_lock<std::mutex> lock(mtx);
+		jobsDone.wait(lock, [this] { return jobs.empty() && active == 0; });
+	}
+
+	int written_count() const { return written; }
+	int failed_count() const { return failed; }
+	// Time geometry workers spent waiting for a free queue slot.
+	double stalled_seconds() const { return stalledMicroseconds / 1e6; }
+
+private:
+	struct Job {
+		std::string path;
+		Sink sink;
+		Mesh mesh;
+		Done done;
+		Stage_Stats::Fixture_Records stats;
+	};
+
+	void enqueue(Job&& job) {
+		job.stats = Stage_Stats::instance().suspend_fixture();
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			slotFree.wait(lock, [this] { return jobs.size() < capacity; });
+			jobs.push_back(std::move(job));
+		}
+		jobReady.notify_one();
+		stalledMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	bool write_file(const Job& job) {
+		fs::path target(job.path);
+		fs::path temp = target;
+		temp += ".tmp" + std::to_string(++tempCounter);
+
+		bool ok;
+		{
+			std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+			ok = out && CGAL::IO::write_STL(out, job.mesh, CGAL::parameters::stream_precision(10));
+			out.close();
+			ok = ok && !out.fail();
+		}
+		std::error_code ec;
+		if (ok) fs::rename(temp, target, ec);
+		if (!ok || ec) {
+			fs::remove(temp, ec);
+			std::cerr << Red << "Error: Cannot write the STL file:  " << ColorEnd << target.filename() << std::endl;
+			return false;
+		}
+		if (DEBUG) std::cout << Yellow << "      Wrote STL file:  " << ColorEnd << target.filename() << std::endl;
+		return true;
+	}
+
+	void worker() {
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (jobs.empty()) return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+				++active;
+			}
+			slotFree.notify_one();
+
+			Stage_Stats::instance().resume_fixture(std::move(job.stats));
+			bool ok;
+			{
+				Stage_Timer timer("write", &job.mesh);
+				ok = job.sink ? job.sink(job.mesh) : write_file(job);
+			}
+			Stage_Stats::instance().end_fixture();
+			if (ok) written++;
+			else failed++;
+			if (job.done) job.done(ok);
+
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				--active;
+				if (jobs.empty() && active == 0) jobsDone.notify_all();
+			}
+		}
+	}
+
+	size_t capacity;
+	std::vector<std::thread> writers;
+	std::deque<Job> jobs;
+	std::mutex mtx;
+	std::condition_variable jobReady, slotFree, jobsDone;
+	unsigned active = 0;
+	bool stopping = false;
+	std::atomic<int> written{ 0 }, failed{ 0 }, tempCounter{ 0 };
+	std::atomic<long long> stalledMicroseconds{ 0 };
+};
+
+#endif // OUTPUT_WRITER_H
@@ -0,0 +1,321 @@
+#ifndef PARALLEL_BOOLEAN_H
+#define PARALLEL_BOOLEAN_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "Concurrency.h"
+#include "Fixture_Common.h"
+
+#include <CGAL/Constrained_Delaunay_triangulation_2.h>
+#include <CGAL/Triangulation_face_base_with_info_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+#include <CGAL/boost/graph/Face_filtered_graph.h>
+#include <CGAL/boost/graph/copy_face_graph.h>
+#include <CGAL/boost/graph/helpers.h>
+#include <CGAL/Polygon_mesh_processing/border.h>
+#include <CGAL/Polygon_mesh_processing/clip.h>
+#include <CGAL/Polygon_mesh_processing/connected_components.h>
+#include <CGAL/Polygon_mesh_processing/corefinement.h>
+#include <CGAL/Polygon_mesh_processing/measure.h>
+#include <CGAL/Polygon_mesh_processing/stitch_borders.h>
+
+// Tile-parallel corefinement booleans.
+//
+// The tool mesh (the glyphs of a tag, say) usually consists of separate
+// components. When their bounding boxes leave gaps along X or Y, the target is
+// split with planes inside those gaps, every slab is capped into a closed
+// volume and run through the boolean with only its own tool components, the
+// slabs concurrently on the shared workers of Concurrency.h. Each cross-section
+// is capped as one polygon with holes (a constrained Delaunay triangulation of
+// all its border cycles), so hollow targets split cleanly. Since no tool
+// component reaches a split plane, the caps come out untouched; they are
+// removed again, which must take exactly the cap area back out, and the slabs
+// are stitched along the seam, whose vertices were created once by the split
+// and so match exactly.
+//
+// Anything that does not partition (a single tool component, overlapping
+// tools, a cross-section that cannot be capped, a failed slab, a cap that
+// changed, an open result) runs the plain serial boolean. FIXTURE_BENCH -CHECK
+// compares tiled and serial results on the bench IDs.
+//
+// Only the tag subtraction of create_fixture has such a tool, and it reaches
+// this code only when the 2D engraving falls back. The model union and the cut
+// have a single closed tool (fixture plus tag, the clipper box), so they call
+// serial_boolean directly and are not parallelised.
+
+enum class Boolean_Op { Difference, Union };
+
+inline bool serial_boolean(Mesh& target, Mesh& tool, Mesh& result, Boolean_Op op) {
+	if (&result != &target && &result != &tool) result.clear();
+	if (op == Boolean_Op::Difference) return PMP::corefine_and_compute_difference(target, tool, result);
+	return PMP::corefine_and_compute_union(target, tool, result);
+}
+
+// Tool components grouped by tile, and the split planes between neighbouring tiles.
+struct Boolean_Tiles {
+	int axis = 0;
+	std::vector<double> planes;                   // ascending split coordinates
+	std::vector<std::vector<std::size_t>> groups; // tool component ids per tile
+};
+
+inline Boolean_Tiles plan_boolean_tiles(const std::vector<CGAL::Bbox_3>& boxes, unsigned maxTiles) {
+	Boolean_Tiles best;
+	for (int axis = 0; axis < 2; ++axis) {
+		std::vector<std::size_t> order(boxes.size());
+		for (std::size_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return boxes[a].min(axis) < boxes[b].min(axis); });
+
+		// Merge overlapping intervals into clusters
+		std::vector<std::vector<std::size_t>> clusters;
+		std::vector<double> gapsAfter;
+		double reach = -std::numeric_limits<double>::infinity();
+		for (std::size_t id : order) {
+			if (clusters.empty()) {
+				clusters.emplace_back();
+			}
+			else if (boxes[id].min(axis) > reach) {
+				gapsAfter.push_back((reach + boxes[id].min(axis)) / 2.0);
+				clusters.emplace_back();
+			}
+			clusters.back().push_back(id);
+			reach = std::max(reach, boxes[id].max(axis));
+		}
+
+		// Combine neighbouring clusters into at most maxTiles tiles of similar size
+		Boolean_Tiles tiles;
+		tiles.axis = axis;
+		std::size_t tileCount = std::min<std::size_t>(clusters.size(), std::max(1u, maxTiles));
+		for (std::size_t c = 0; c < clusters.size(); ++c) {
+			std::size_t tile = c * tileCount / clusters.size();
+			if (tile == tiles.groups.size()) {
+				if (c > 0) tiles.planes.push_back(gapsAfter[c - 1]);
+				tiles.groups.emplace_back();
+			}
+			tiles.groups.back().insert(tiles.groups.back().end(), clusters[c].begin(), clusters[c].end());
+		}
+		if (tiles.groups.size() > best.groups.size()) best = std::move(tiles);
+	}
+	return best;
+}
+
+// Copies the faces whose component id is in ids into a new mesh.
+template <typename ComponentMap>
+Mesh extract_components(const Mesh& mesh, const std::vector<std::size_t>& ids, const ComponentMap& components) {
+	Mesh part;
+	if (ids.empty()) return part;
+	CGAL::Face_filtered_graph<Mesh> filtered(mesh, ids, components);
+	CGAL::copy_face_graph(filtered, part);
+	return part;
+}
+
+// Split vertices are constructed, so they lie on their plane only up to rounding.
+constexpr double SPLIT_PLANE_TOLERANCE = 1e-7; // mm
+
+// Index of the split plane p lies on, or -1.
+inline int plane_of(const Point& p, int axis, const std::vector<double>& planes) {
+	for (std::size_t i = 0; i < planes.size(); ++i) {
+		if (std::abs(p[axis] - planes[i]) <= SPLIT_PLANE_TOLERANCE) return static_cast<int>(i);
+	}
+	return -1;
+}
+
+inline bool on_plane(const Mesh& mesh, Face_index f, int axis, const std::vector<double>& planes) {
+	int plane = -1;
+	for (Vertex_index v : vertices_around_face(mesh.halfedge(f), mesh)) {
+		int here = plane_of(mesh.point(v), axis, planes);
+		if (here < 0 || (plane >= 0 && here != plane)) return false;
+		plane = here;
+	}
+	return true;
+}
+
+struct Section_Face_Info {
+	bool visited = false, inside = false;
+};
+
+typedef CGAL::Triangulation_vertex_base_with_info_2<Vertex_index, Kernel> Section_Vb;
+typedef CGAL::Constrained_triangulation_face_base_2<Kernel> Section_Cfb;
+typedef CGAL::Triangulation_face_base_with_info_2<Section_Face_Info, Kernel, Section_Cfb> Section_Fb;
+typedef CGAL::Triangulation_data_structure_2<Section_Vb, Section_Fb> Section_Tds;
+typedef CGAL::Constrained_Delaunay_triangulation_2<Kernel, Section_Tds, CGAL::No_constraint_intersection_tag> Section_CDT;
+
+// Closes the cross-sections the split left open. All border cycles on one
+// plane are triangulated together, inside where they nest an odd number of
+// times, and the triangles follow the border halfedges. Returns the cap area,
+// or a negative value if a border leaves the planes or the cycles touch.
+inline double cap_cross_sections(Mesh& slab, int axis, const std::vector<double>& planes) {
+	std::vector<Halfedge_index> borders;
+	PMP::extract_boundary_cycles(slab, std::back_inserter(borders));
+	std::map<int, std::vector<std::vector<Vertex_index>>> sections;
+	for (Halfedge_index start : borders) {
+		std::vector<Vertex_index> cycle;
+		int plane = plane_of(slab.point(slab.source(start)), axis, planes);
+		Halfedge_index h = start;
+		do {
+			if (plane < 0 || plane_of(slab.point(slab.source(h)), axis, planes) != plane) return -1.0;
+			cycle.push_back(slab.source(h));
+			h = slab.next(h);
+		} while (h != start);
+		sections[plane].push_back(std::move(cycle));
+	}
+
+	const int u = (axis + 1) % 3, w = (axis + 2) % 3;
+	auto project = [&](Vertex_index v) { return Kernel::Point_2(slab.point(v)[u], slab.point(v)[w]); };
+	std::vector<std::array<Vertex_index, 3>> triangles;
+	for (const auto& section : sections) {
+		Section_CDT cdt;
+		double signedArea = 0.0;
+		try {
+			for (const std::vector<Vertex_index>& cycle : section.second) {
+				std::vector<Section_CDT::Vertex_handle> handles;
+				for (Vertex_index v : cycle) {
+					std::size_t before = cdt.number_of_vertices();
+					Section_CDT::Vertex_handle handle = cdt.insert(project(v));
+					if (cdt.number_of_vertices() == before) return -1.0; // cycles touch
+					handle->info() = v;
+					handles.push_back(handle);
+				}
+				for (std::size_t i = 0; i < cycle.size(); ++i) {
+					std::size_t j = (i + 1) % cycle.size();
+					cdt.insert_constraint(handles[i], handles[j]);
+					Kernel::Point_2 a = project(cycle[i]), b = project(cycle[j]);
+					signedArea += a.x() * b.y() - b.x() * a.y();
+				}
+			}
+		}
+		catch (const std::exception&) {
+			return -1.0;
+		}
+
+		std::queue<Section_CDT::Face_handle> open;
+		cdt.infinite_face()->info().visited = true;
+		open.push(cdt.infinite_face());
+		while (!open.empty()) {
+			Section_CDT::Face_handle f = open.front();
+			open.pop();
+			for (int i = 0; i < 3; ++i) {
+				Section_CDT::Face_handle n = f->neighbor(i);
+				if (n->info().visited) continue;
+				n->info().visited = true;
+				n->info().inside = f->is_constrained(i) ? !f->info().inside : f->info().inside;
+				open.push(n);
+			}
+		}
+		// The CDT is counter-clockwise; the cap runs with the border halfedges.
+		bool flip = signedArea < 0.0;
+		for (Section_CDT::Finite_faces_iterator f = cdt.finite_faces_begin(); f != cdt.finite_faces_end(); ++f) {
+			if (!f->info().inside) continue;
+			Vertex_index a = f->vertex(0)->info(), b = f->vertex(1)->info(), c = f->vertex(2)->info();
+			triangles.push_back(flip ? std::array<Vertex_index, 3>{ a, c, b } : std::array<Vertex_index, 3>{ a, b, c });
+		}
+	}
+
+	double area = 0.0;
+	for (const auto& t : triangles) {
+		if (slab.add_face(t[0], t[1], t[2]) == Mesh::null_face()) return -1.0;
+		area += std::sqrt(CGAL::squared_area(slab.point(t[0]), slab.point(t[1]), slab.point(t[2])));
+	}
+	return CGAL::is_closed(slab) ? area : -1.0;
+}
+
+inline bool tiled_boolean(Mesh& target, Mesh& tool, Mesh& result, Boolean_Op op, unsigned threads) {
+	auto toolComponents = tool.add_property_map<Face_index, std::size_t>("f:tile_component", 0).first;
+	std::size_t toolCount = PMP::connected_components(tool, toolComponents);
+	if (toolCount < 2) {
+		tool.remove_property_map(toolComponents);
+		return false;
+	}
+
+	std::vector<CGAL::Bbox_3> boxes(toolCount);
+	for (Face_index f : tool.faces()) {
+		for (Vertex_index v : vertices_around_face(tool.halfedge(f), tool)) boxes[toolComponents[f]] += tool.point(v).bbox();
+	}
+	Boolean_Tiles tiles = plan_boolean_tiles(boxes, threads);
+	if (tiles.groups.size() < 2) {
+		tool.remove_property_map(toolComponents);
+		return false;
+	}
+
+	// Split the target along every plane; the seam vertices are shared by both sides.
+	Mesh split = target;
+	for (double plane : tiles.planes) {
+		Kernel::Plane_3 cut(tiles.axis == 0 ? 1 : 0, tiles.axis == 1 ? 1 : 0, 0, -plane);
+		PMP::split(split, cut);
+	}
+	auto splitComponents = split.add_property_map<Face_index, std::size_t>("f:tile_component", 0).first;
+	std::size_t splitCount = PMP::connected_components(split, splitComponents);
+
+	// A split component belongs to the tile holding the midpoint of its extent.
+	std::vector<CGAL::Bbox_3> splitBoxes(splitCount);
+	for (Face_index f : split.faces()) {
+		for (Vertex_index v : vertices_around_face(split.halfedge(f), split)) splitBoxes[splitComponents[f]] += split.point(v).bbox();
+	}
+	std::vector<std::vector<std::size_t>> targetGroups(tiles.groups.size());
+	for (std::size_t c = 0; c < splitCount; ++c) {
+		double middle = (splitBoxes[c].min(tiles.axis) + splitBoxes[c].max(tiles.axis)) / 2.0;
+		std::size_t tile = std::upper_bound(tiles.planes.begin(), tiles.planes.end(), middle) - tiles.planes.begin();
+		targetGroups[tile].push_back(c);
+	}
+
+	std::vector<Mesh> pieces(tiles.groups.size());
+	std::vector<char> done(tiles.groups.size(), 0);
+	parallel_for(tiles.groups.size(), [&](std::size_t t) {
+		done[t] = [&] {
+			try {
+				Mesh slab = extract_components(split, targetGroups[t], splitComponents);
+				Mesh slabTool = extract_components(tool, tiles.groups[t], toolComponents);
+				double capArea = cap_cross_sections(slab, tiles.axis, tiles.planes);
+				if (capArea < 0.0) return false;
+				if (!serial_boolean(slab, slabTool, pieces[t], op)) return false;
+
+				// Only the caps may lie on the planes, and they must come back whole.
+				std::vector<Face_index> caps;
+				double removedArea = 0.0;
+				for (Face_index f : pieces[t].faces()) {
+					if (!on_plane(pieces[t], f, tiles.axis, tiles.planes)) continue;
+					caps.push_back(f);
+					removedArea += PMP::face_area(f, pieces[t]);
+				}
+				if (std::abs(removedArea - capArea) > 1e-6 * std::max(1.0, capArea)) return false;
+				for (Face_index f : caps) CGAL::Euler::remove_face(pieces[t].halfedge(f), pieces[t]);
+				pieces[t].collect_garbage();
+				return true;
+			}
+			catch (const std::exception&) {
+				return false;
+			}
+		}();
+	});
+	bool ok = std::all_of(done.begin(), done.end(), [](char d) { return d != 0; });
+	tool.remove_property_map(toolComponents);
+	if (!ok) return false;
+
+	result.clear();
+	for (const Mesh& piece : pieces) result.join(piece);
+	PMP::stitch_borders(result);
+	result.collect_garbage();
+	return CGAL::is_closed(result);
+}
+
+// target op tool into result, which may be target itself. Both inputs may be
+// corefined in place, as with the PMP functions. threads == 0 takes what
+// available_threads() allows here, and 1 is always serial.
+inline bool boolean_operation(Mesh& target, Mesh& tool, Mesh& result, Boolean_Op op, unsigned threads = 0) {
+	if (threads == 0) threads = available_threads();
+	if (threads > 1 && CGAL::is_closed(target) && CGAL::is_triangle_mesh(target)) {
+		if (tiled_boolean(target, tool, result, op, threads)) return true;
+		if (DEBUG) std::cout << Yellow << "      Boolean runs serially." << ColorEnd << std::endl;
+	}
+	return serial_boolean(target, tool, result, op);
+}
+
+#endif // PARALLEL_BOOLEAN_H
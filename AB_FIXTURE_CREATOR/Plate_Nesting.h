@@ -0,0 +1,259 @@
+#ifndef PLATE_NESTING_H
+#define PLATE_NESTING_H
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "Fixture_Mesh.h"
+#include "Case_Archive.h"
+
+#include <CGAL/IO/STL.h>
+
+// Build-plate nesting of finished fixtures.
+//
+// Parts are packed by their XY bounding boxes with first-fit decreasing
+// height shelves: parts are sorted by depth (Y extent), each goes onto the
+// first shelf of the first plate with room for it, a new shelf is opened on
+// the first plate with height left, and a new plate after that. With the
+// identical footprints of one case this fills rows exactly and runs in
+// microseconds. Parts keep their orientation so every tag reads the same way.
+//
+// Plates span [0, width] x [0, length] in printer coordinates; spacing is
+// kept between parts and to the plate edge. A part larger than the plate is
+// left unplaced and reported.
+
+struct Plate_Settings {
+	bool enabled = false;
+	double width = 250.0, length = 210.0, spacing = 3.0;
+
+	// Parses "W,L[,spacing]"; false leaves the settings untouched.
+	bool parse(const std::string& text) {
+		double w, l, s = spacing;
+		int count = std::sscanf(text.c_str(), "%lf,%lf,%lf", &w, &l, &s);
+		if (count < 2 || w <= 0 || l <= 0 || s < 0) return false;
+		width = w;
+		length = l;
+		spacing = s;
+		enabled = true;
+		return true;
+	}
+};
+
+struct Nest_Placement {
+	int plate = -1;         // -1 when the part fits on no plate
+	double x = 0.0, y = 0.0; // where the footprint's min corner goes
+};
+
+// Packs the footprints and returns the number of plates used.
+inline int nest_footprints(const std::vector<CGAL::Bbox_2>& footprints, const Plate_Settings& settings, std::vector<Nest_Placement>& placements) {
+	struct Shelf { double y, height, x; };
+	std::vector<std::vector<Shelf>> plates;
+	std::vector<double> plateTop; // first free y per plate
+	placements.assign(footprints.size(), Nest_Placement());
+
+	std::vector<std::size_t> order(footprints.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+		return footprints[a].ymax() - footprints[a].ymin() > footprints[b].ymax() - footprints[b].ymin();
+	});
+
+	const double s = settings.spacing;
+	for (std::size_t i : order) {
+		double w = footprints[i].xmax() - footprints[i].xmin(), h = footprints[i].ymax() - footprints[i].ymin();
+		if (w + 2 * s > settings.width || h + 2 * s > settings.length) continue;
+
+		Nest_Placement& placed = placements[i];
+		for (std::size_t p = 0; p < plates.size() && placed.plate < 0; ++p) {
+			for (Shelf& shelf : plates[p]) {
+				if (h <= shelf.height && shelf.x + w + s <= settings.width) {
+					placed = { static_cast<int>(p), shelf.x, shelf.y };
+					shelf.x += w + s;
+					break;
+				}
+			}
+			if (placed.plate < 0 && plateTop[p] + h + s <= settings.length) {
+				plates[p].push_back({ plateTop[p], h, s + w + s });
+				placed = { static_cast<int>(p), s, plateTop[p] };
+				plateTop[p] += h + s;
+			}
+		}
+		if (placed.plate < 0) {
+			plates.push_back({ { s, h, s + w + s } });
+			plateTop.push_back(s + h + s);
+			placed = { static_cast<int>(plates.size() - 1), s, s };
+		}
+	}
+	return static_cast<int>(plates.size());
+}
+
+// Lays the objects of a case archive out on its one build: nested as on
+// plates of the settings' size, in name order, with the plates side by side
+// along X and parts larger than a plate in a row after them. Without it every
+// object added without an offset sits at the origin. Empty objects stay there.
+inline void arrange_archive(Case_Archive& archive, const Plate_Settings& settings) {
+	std::vector<std::pair<std::string, CGAL::Bbox_2>> objects = archive.objects();
+	std::vector<std::size_t> order;
+	for (std::size_t i = 0; i < objects.size(); ++i) {
+		if (objects[i].second.xmin() <= objects[i].second.xmax()) order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return objects[a].first < objects[b].first; });
+	std::vector<CGAL::Bbox_2> footprints;
+	for (std::size_t i : order) footprints.push_back(objects[i].second);
+	std::vector<Nest_Placement> placements;
+	double plateStep = settings.width + settings.spacing;
+	double beyond = nest_footprints(footprints, settings, placements) * plateStep + settings.spacing;
+
+	for (std::size_t k = 0; k < order.size(); ++k) {
+		const CGAL::Bbox_2& footprint = footprints[k];
+		double x = beyond, y = settings.spacing;
+		if (placements[k].plate >= 0) {
+			x = placements[k].plate * plateStep + placements[k].x;
+			y = placements[k].y;
+		}
+		else {
+			beyond += footprint.xmax() - footprint.xmin() + settings.spacing;
+		}
+		archive.place(order[k], Vector(x - footprint.xmin(), y - footprint.ymin(), 0));
+	}
+}
+
+inline CGAL::Bbox_2 mesh_footprint(const Mesh& mesh) {
+	CGAL::Bbox_2 box;
+	for (Vertex_index v : mesh.vertices()) box += CGAL::Bbox_2(mesh.point(v).x(), mesh.point(v).y(), mesh.point(v).x(), mesh.point(v).y());
+	return box;
+}
+
+// Collects finished fixtures from any thread and writes them nested, one
+// file per plate: prefix_plate1.stl, ... (or .3mf with every part its own object).
+// Only the footprints stay in memory: each mesh is spilled to an STL in a
+// temporary directory as it arrives, in the same format as the output cache,
+// and read back one at a time while its plate is assembled.
+class Plate_Nester {
+public:
+	explicit Plate_Nester(const Plate_Settings& settings) : settings(settings) {
+		spillDirectory = fs::temp_directory_path() / ("fixture_plates_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+		std::error_code ec;
+		fs::create_directories(spillDirectory, ec);
+	}
+
+	~Plate_Nester() {
+		std::error_code ec;
+		fs::remove_all(spillDirectory, ec);
+	}
+
+	Plate_Nester(const Plate_Nester&) = delete;
+	Plate_Nester& operator=(const Plate_Nester&) = delete;
+
+	// False if the mesh could not be spilled; the part is then left out.
+	bool add(const std::string& name, Mesh&& mesh) {
+		CGAL::Bbox_2 footprint = mesh_footprint(mesh);
+		fs::path file = spillDirectory / ("part" + std::to_string(++spillCounter) + ".stl");
+		bool ok;
+		{
+			std::ofstream out(file, std::ios::binary | std::ios::trunc);
+			ok = out && CGAL::IO::write_STL(out, mesh, CGAL::parameters::stream_precision(10));
+			out.close();
+			ok = ok && !out.fail();
+		}
+		mesh.clear();
+		if (!ok) {
+			std::error_code ec;
+			fs::remove(file, ec);
+			std::cerr << Red << "      Error: Cannot keep the part for nesting:  " << ColorEnd << name << std::endl;
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mtx);
+		parts.push_back(Part{ name, footprint, file });
+		return true;
+	}
+
+	// Returns the number of parts written; unplaced parts and failed plates are reported.
+	int write_plates(const std::string& prefix, bool archive) {
+		std::lock_guard<std::mutex> lock(mtx);
+		// Nest in name order so the same case always gives the same plates
+		std::sort(parts.begin(), parts.end(), [](const Part& a, const Part& b) { return a.name < b.name; });
+		std::vector<CGAL::Bbox_2> footprints;
+		for (const Part& part : parts) footprints.push_back(part.footprint);
+		std::vector<Nest_Placement> placements;
+		int plateCount = nest_footprints(footprints, settings, placements);
+
+		int written = 0;
+		for (int plate = 0; plate < plateCount; ++plate) {
+			std::string path = prefix + "_plate" + std::to_string(plate + 1) + (archive ? ".3mf" : ".stl");
+			int count = 0;
+			bool ok;
+			if (archive) {
+				Case_Archive plateArchive(path, fs::path(prefix).filename().string() + " plate " + std::to_string(plate + 1));
+				ok = true;
+				for (std::size_t i = 0; i < parts.size(); ++i) {
+					if (placements[i].plate != plate) continue;
+					Mesh Part_Mesh;
+					ok = read_part(i, Part_Mesh) && plateArchive.add(parts[i].name, Part_Mesh, offset_of(i, placements[i])) && ok;
+					++count;
+				}
+				ok = plateArchive.close() && ok;
+			}
+			else {
+				Mesh Plate_Mesh;
+				ok = true;
+				for (std::size_t i = 0; i < parts.size(); ++i) {
+					if (placements[i].plate != plate) continue;
+					Mesh Part_Mesh;
+					if (read_part(i, Part_Mesh)) {
+						translate_mesh(Part_Mesh, offset_of(i, placements[i]));
+						CGAL::copy_face_graph(Part_Mesh, Plate_Mesh);
+					}
+					else {
+						ok = false;
+					}
+					++count;
+				}
+				ok = write_STL(path, Plate_Mesh) && ok;
+			}
+			if (ok) written += count;
+			std::cout << "      Plate " << plate + 1 << ":  " << Yellow << count << ColorEnd << " fixtures -> "
+				<< fs::path(path).filename().string() << std::endl;
+		}
+		std::error_code ec;
+		for (std::size_t i = 0; i < parts.size(); ++i) {
+			if (placements[i].plate < 0) std::cerr << Red << "      Larger than the build plate:  " << ColorEnd << parts[i].name << std::endl;
+			fs::remove(parts[i].file, ec);
+		}
+		parts.clear();
+		return written;
+	}
+
+private:
+	struct Part {
+		std::string name;
+		CGAL::Bbox_2 footprint;
+		fs::path file; // the spilled mesh
+	};
+
+	bool read_part(std::size_t i, Mesh& mesh) const {
+		return read_STL(parts[i].file.string(), mesh);
+	}
+
+	Vector offset_of(std::size_t i, const Nest_Placement& placed) const {
+		return Vector(placed.x - parts[i].footprint.xmin(), placed.y - parts[i].footprint.ymin(), 0);
+	}
+
+	Plate_Settings settings;
+	fs::path spillDirectory;
+	std::atomic<int> spillCounter{ 0 };
+	std::mutex mtx;
+	std::vector<Part> parts;
+};
+
+#endif // PLATE_NESTING_H
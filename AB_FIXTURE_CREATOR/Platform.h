@@ -0,0 +1,93 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#include <io.h>
+#include <psapi.h>
+#pragma comment(lib, "Psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "Fixture_Common.h"
+
+// Console and session helpers that differ between Windows and Linux.
+
+inline void setConsoleSize(int width, int height) {
+#ifdef _WIN32
+	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE); // Get the standard output handle
+	if (hStdout == INVALID_HANDLE_VALUE || hStdout == nullptr) return; // No console attached
+
+	COORD newSize;
+	newSize.X = width;
+	newSize.Y = 32766; // Maximal possible height for the console window
+	SetConsoleScreenBufferSize(hStdout, newSize);
+
+	SMALL_RECT windowSize;
+	windowSize.Top = 0;
+	windowSize.Left = 0;
+	windowSize.Right = width - 1;  // Width of the window
+	windowSize.Bottom = height - 1;  // Height of the window
+
+	if (!SetConsoleWindowInfo(hStdout, TRUE, &windowSize)) {
+		std::cerr << "Setting console window size failed." << std::endl;
+	}
+#else
+	(void)width;
+	(void)height; // Terminals size themselves
+#endif
+}
+
+// True when stdin is a terminal someone can answer prompts on.
+inline bool console_attached() {
+#if defined(FIXTURE_HEADLESS)
+	return false;
+#elif defined(_WIN32)
+	return _isatty(_fileno(stdin)) != 0;
+#else
+	return isatty(fileno(stdin)) != 0;
+#endif
+}
+
+// DOMAIN\user on Windows, user@host elsewhere.
+inline std::string current_user() {
+#ifdef _WIN32
+	return get_env("USERDOMAIN", "Unknown") + "\\" + get_env("USERNAME", "Unknown");
+#else
+	char host[256] = "Unknown";
+	gethostname(host, sizeof(host) - 1);
+	return get_env("USER", "Unknown") + "@" + host;
+#endif
+}
+
+// Largest resident set of this process so far, in bytes (0 when unknown).
+inline size_t peak_rss_bytes() {
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+	return static_cast<size_t>(usage.ru_maxrss);        // bytes
+#else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+#endif // PLATFORM_H
@@ -0,0 +1,235 @@
+#ifndef POINT_SOA_H
+#define POINT_SOA_H
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "Fixture_Common.h"
+
+// Structure-of-arrays view of mesh points for the transform stages.
+//
+// The coordinates are copied into three 32-byte aligned arrays, the kernels
+// below run over them (AVX2 when the compiler targets it, /arch:AVX2 or
+// -mavx2, scalar otherwise) and sync() writes them back into the mesh. A
+// modified view syncs itself when it goes out of scope, so several stages can
+// be chained and the mesh only sees the result:
+//
+//   {
+//       Point_SoA points(Tag_Mesh, first);
+//       points.scale_profile(profile);
+//       points.translate(dx, dy, 0, begin, end);   // per glyph
+//   }   // written back here, before any CGAL algorithm touches the mesh
+//
+// The copy in and out costs about as much as one pass over the mesh, so only
+// chains of stages use a view; a single transform (scaleMesh, translate_mesh,
+// settle_mesh_z0) runs in place on the mesh points.
+//
+// The kernels do the same floating point operations as the Point arithmetic
+// they replace, so results are bit-identical on either path.
+
+template <typename T, std::size_t Alignment>
+struct Aligned_Allocator {
+	typedef T value_type;
+	template <typename U> struct rebind { typedef Aligned_Allocator<U, Alignment> other; };
+
+	Aligned_Allocator() = default;
+	template <typename U> Aligned_Allocator(const Aligned_Allocator<U, Alignment>&) {}
+
+	T* allocate(std::size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+	void deallocate(T* p, std::size_t) { ::operator delete(p, std::align_val_t(Alignment)); }
+
+	template <typename U> bool operator==(const Aligned_Allocator<U, Alignment>&) const { return true; }
+	template <typename U> bool operator!=(const Aligned_Allocator<U, Alignment>&) const { return false; }
+};
+
+typedef std::vector<double, Aligned_Allocator<double, 32>> Aligned_Doubles;
+
+// XY scale as a function of z, for tapers, chamfers and draft angles. The
+// knots are (z, scale) pairs with ascending z. Stepped profiles take the scale
+// of the last knot strictly below the point (the first knot's scale below
+// all of them); interpolated profiles blend linearly between neighbouring
+// knots and hold the end values outside. z itself is multiplied by Zscale.
+// Check valid() before evaluating a profile whose knots were edited by hand.
+struct Scale_Profile {
+	std::vector<double> knotZ, knotScale;
+	double Zscale = 1.0;
+	bool interpolate = false;
+
+	// Two bands split at zThreshold; what scaleMesh has always done.
+	static Scale_Profile threshold(double XYscale, double XYtopscale, double Zscale, double zThreshold) {
+		Scale_Profile profile;
+		profile.knotZ = { -std::numeric_limits<double>::infinity(), zThreshold };
+		profile.knotScale = { XYscale, XYtopscale };
+		profile.Zscale = Zscale;
+		return profile;
+	}
+
+	// Linear taper from bottomScale at bottomZ to topScale at topZ.
+	static Scale_Profile taper(double bottomZ, double bottomScale, double topZ, double topScale, double Zscale = 1.0) {
+		Scale_Profile profile;
+		profile.knotZ = { bottomZ, topZ };
+		profile.knotScale = { bottomScale, topScale };
+		profile.Zscale = Zscale;
+		profile.interpolate = true;
+		return profile;
+	}
+
+	// One scale per z, all finite, and z ascending. Interpolated knots must be
+	// finite and strictly ascending, since every segment divides by its width.
+	bool valid() const {
+		if (knotZ.size() != knotScale.size() || !std::isfinite(Zscale)) return false;
+		for (std::size_t k = 0; k < knotZ.size(); ++k) {
+			if (!std::isfinite(knotScale[k]) || std::isnan(knotZ[k])) return false;
+			if (interpolate && !std::isfinite(knotZ[k])) return false;
+			if (k > 0 && (interpolate ? knotZ[k] <= knotZ[k - 1] : knotZ[k] < knotZ[k - 1])) return false;
+		}
+		return true;
+	}
+
+	// Reference evaluation in the kernels' select form: no branch on z, and a
+	// NaN t clamps to 0 as _mm256_max_pd makes it.
+	double xy_scale(double z) const {
+		if (knotScale.empty()) return 1.0;
+		double scale = knotScale[0];
+		if (interpolate) {
+			for (std::size_t k = 1; k < knotZ.size(); ++k) {
+				double t = (z - knotZ[k - 1]) / (knotZ[k] - knotZ[k - 1]);
+				t = t > 0.0 ? t : 0.0;
+				t = t < 1.0 ? t : 1.0;
+				scale += t * (knotScale[k] - knotScale[k - 1]);
+			}
+		}
+		else {
+			for (std::size_t k = 1; k < knotZ.size(); ++k) scale = z > knotZ[k] ? knotScale[k] : scale;
+		}
+		return scale;
+	}
+};
+
+class Point_SoA {
+public:
+	// Views the live vertices with index in [first, last), all of them by default.
+	explicit Point_SoA(Mesh& mesh, Mesh::size_type first = 0, Mesh::size_type last = std::numeric_limits<Mesh::size_type>::max())
+		: mesh(mesh), first(first) {
+		last = std::min<Mesh::size_type>(last, mesh.num_vertices());
+		this->first = std::min(first, last);
+		if (mesh.has_garbage()) {
+			for (Vertex_index v : mesh.vertices()) {
+				if (v >= Vertex_index(this->first) && v < Vertex_index(last)) ids.push_back(v);
+			}
+			gathered = true;
+		}
+		std::size_t n = gathered ? ids.size() : last - this->first;
+		xs.resize(n);
+		ys.resize(n);
+		zs.resize(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			const Point& p = mesh.point(vertex(i));
+			xs[i] = p.x();
+			ys[i] = p.y();
+			zs[i] = p.z();
+		}
+	}
+
+	~Point_SoA() { sync(); }
+
+	Point_SoA(const Point_SoA&) = delete;
+	Point_SoA& operator=(const Point_SoA&) = delete;
+
+	std::size_t size() const { return xs.size(); }
+	double* x() { dirty = true; return xs.data(); }
+	double* y() { dirty = true; return ys.data(); }
+	double* z() { dirty = true; return zs.data(); }
+	const double* x() const { return xs.data(); }
+	const double* y() const { return ys.data(); }
+	const double* z() const { return zs.data(); }
+
+	// Writes the coordinates back into the mesh if a kernel changed them.
+	void sync() {
+		if (!dirty) return;
+		for (std::size_t i = 0; i < size(); ++i) mesh.point(vertex(i)) = Point(xs[i], ys[i], zs[i]);
+		dirty = false;
+	}
+
+	// Moves the points [begin, end) of the view, all of them by default.
+	void translate(double dx, double dy, double dz, std::size_t begin = 0, std::size_t end = std::numeric_limits<std::size_t>::max()) {
+		double* px = x(); double* py = y(); double* pz = z();
+		std::size_t i = std::min(begin, size()), n = std::min(end, size());
+#if defined(__AVX2__)
+		const __m256d vx = _mm256_set1_pd(dx), vy = _mm256_set1_pd(dy), vz = _mm256_set1_pd(dz);
+		for (; i + 4 <= n; i += 4) { // a sub-range may start off the 32-byte boundary
+			_mm256_storeu_pd(px + i, _mm256_add_pd(_mm256_loadu_pd(px + i), vx));
+			_mm256_storeu_pd(py + i, _mm256_add_pd(_mm256_loadu_pd(py + i), vy));
+			_mm256_storeu_pd(pz + i, _mm256_add_pd(_mm256_loadu_pd(pz + i), vz));
+		}
+#endif
+		for (; i < n; ++i) {
+			px[i] += dx;
+			py[i] += dy;
+			pz[i] += dz;
+		}
+	}
+
+	// Scales x and y by profile.xy_scale(z) and z by profile.Zscale. Every knot
+	// is applied to every lane with compares and blends, so the loop has no
+	// data-dependent branches. False, with the points untouched, if the profile
+	// is not valid().
+	bool scale_profile(const Scale_Profile& profile) {
+		if (!profile.valid()) return false;
+		std::size_t i = 0, n = size(), knots = profile.knotScale.size();
+		if (knots == 0) return true;
+		double* px = x(); double* py = y(); double* pz = z();
+		const double* kz = profile.knotZ.data();
+		const double* ks = profile.knotScale.data();
+#if defined(__AVX2__)
+		const __m256d vz = _mm256_set1_pd(profile.Zscale), zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+		for (; i + 4 <= n; i += 4) {
+			__m256d z4 = _mm256_load_pd(pz + i);
+			__m256d s = _mm256_set1_pd(ks[0]);
+			for (std::size_t k = 1; k < knots; ++k) {
+				if (profile.interpolate) {
+					__m256d t = _mm256_div_pd(_mm256_sub_pd(z4, _mm256_set1_pd(kz[k - 1])), _mm256_set1_pd(kz[k] - kz[k - 1]));
+					t = _mm256_min_pd(_mm256_max_pd(t, zero), one);
+					s = _mm256_add_pd(s, _mm256_mul_pd(t, _mm256_set1_pd(ks[k] - ks[k - 1])));
+				}
+				else {
+					s = _mm256_blendv_pd(s, _mm256_set1_pd(ks[k]), _mm256_cmp_pd(z4, _mm256_set1_pd(kz[k]), _CMP_GT_OQ));
+				}
+			}
+			_mm256_store_pd(px + i, _mm256_mul_pd(_mm256_load_pd(px + i), s));
+			_mm256_store_pd(py + i, _mm256_mul_pd(_mm256_load_pd(py + i), s));
+			_mm256_store_pd(pz + i, _mm256_mul_pd(z4, vz));
+		}
+#endif
+		for (; i < n; ++i) {
+			double s = profile.xy_scale(pz[i]);
+			px[i] *= s;
+			py[i] *= s;
+			pz[i] *= profile.Zscale;
+		}
+		return true;
+	}
+
+private:
+	Vertex_index vertex(std::size_t i) const {
+		return gathered ? ids[i] : Vertex_index(static_cast<Mesh::size_type>(first + i));
+	}
+
+	Mesh& mesh;
+	Mesh::size_type first;
+	std::vector<Vertex_index> ids; // only when the mesh has removed vertices
+	bool gathered = false;
+	Aligned_Doubles xs, ys, zs;
+	bool dirty = false;
+};
+
+#endif // POINT_SOA_H
@@ -0,0 +1,144 @@
+#ifndef PREVIEW_WORKER_H
+#define PREVIEW_WORKER_H
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "Fixture_Common.h"
+#include "Fixture_Mesh.h"
+#include "Model_Decimation.h"
+#include "Parallel_Boolean.h"
+
+// Background preview of the placement chosen in the viewer.
+//
+// The viewer only moves actors; the cut and the union run after it closes.
+// This worker runs the same steps as OCR_FIXTURE_TOOL does afterwards (move,
+// rotate about Z, cut, union with the fixture tag) on a decimated proxy of
+// the model, so the operator sees the result while still placing it.
+//
+// Every setter bumps a generation counter and wakes the worker, which always
+// builds from the newest values. A boolean cannot be interrupted, so a job
+// checks the counter between its stages and gives up as soon as it is stale;
+// only a result whose generation is still current is handed over. take()
+// never waits for a job, so the render loop polls it from a timer.
+//
+// The worker reads the model and the tag in place, so both must outlive it;
+// the viewer thread never copies the scan. Destruction cancels the proxy
+// decimation and waits for at most the boolean that is running.
+struct Preview_Params {
+	double x = 0.0, y = 0.0, rotZ = 0.0, cut = 0.0;
+};
+
+class Preview_Worker {
+public:
+	Preview_Worker(const Mesh& Model_Mesh, const Mesh& Fixture_Tag_Mesh, std::size_t proxyFaces = 20000)
+		: model(Model_Mesh), tag(Fixture_Tag_Mesh), proxyFaces(proxyFaces) {
+		thread = std::thread([this] { run(); });
+	}
+
+	~Preview_Worker() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+		}
+		wake.notify_all();
+		thread.join();
+	}
+
+	Preview_Worker(const Preview_Worker&) = delete;
+	Preview_Worker& operator=(const Preview_Worker&) = delete;
+
+	void set_offset(double x, double y) { update([=](Preview_Params& p) { p.x = x; p.y = y; }); }
+	void set_rotation(double rotZ) { update([=](Preview_Params& p) { p.rotZ = rotZ; }); }
+	void set_cut(double cut) { update([=](Preview_Params& p) { p.cut = cut; }); }
+
+	// The finished preview for the current values, once; null while it is being built.
+	std::unique_ptr<Mesh> take() {
+		std::lock_guard<std::mutex> lock(mtx);
+		return std::move(ready);
+	}
+
+private:
+	void update(const std::function<void(Preview_Params&)>& change) {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			change(params);
+			++generation;
+		}
+		wake.notify_one();
+	}
+
+	bool stale(uint64_t job) const { return generation.load() != job || stopping; }
+
+	void run() {
+		// The proxy is built here so the viewer opens without waiting for it
+		Mesh proxy;
+		if (!make_preview_proxy(model, proxy, proxyFaces, &stopping)) return;
+		uint64_t built = 0;
+		for (;;) {
+			Preview_Params job;
+			uint64_t jobGeneration;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				wake.wait(lock, [&] { return stopping || generation.load() != built; });
+				if (stopping) return;
+				job = params;
+				jobGeneration = built = generation.load();
+			}
+			auto result = std::make_unique<Mesh>();
+			if (!build(proxy, job, jobGeneration, *result)) continue;
+			std::lock_guard<std::mutex> lock(mtx);
+			if (generation.load() == jobGeneration) ready = std::move(result);
+		}
+	}
+
+	// Same order as the tool: translate, rotate about the origin, cut, union.
+	bool build(const Mesh& proxy, const Preview_Params& job, uint64_t jobGeneration, Mesh& result) {
+		Mesh placed = proxy;
+		double c = std::cos(job.rotZ * M_PI / 180.0), s = std::sin(job.rotZ * M_PI / 180.0);
+		for (Vertex_index v : placed.vertices()) {
+			const Point& p = placed.point(v);
+			double x = p.x() + job.x, y = p.y() + job.y;
+			placed.point(v) = Point(c * x - s * y, s * x + c * y, p.z());
+		}
+		if (stale(jobGeneration)) return false;
+
+		if (job.cut >= 0.1) {
+			Mesh clipper, cut;
+			make_cut_clipper(job.cut, clipper);
+			if (!serial_boolean(placed, clipper, cut, Boolean_Op::Difference)) return false;
+			settle_mesh_z0(cut);
+			std::swap(placed, cut);
+		}
+
+		if (stale(jobGeneration)) return false;
+		Mesh tool = tag;
+		if (!serial_boolean(placed, tool, result, Boolean_Op::Union)) {
+			// Show both parts, as the tool would keep them
+			result.clear();
+			CGAL::copy_face_graph(tag, result);
+			CGAL::copy_face_graph(placed, result);
+		}
+		return !stale(jobGeneration);
+	}
+
+	const Mesh& model;
+	const Mesh& tag;
+	std::size_t proxyFaces;
+	std::mutex mtx;
+	std::condition_variable wake;
+	Preview_Params params;
+	std::atomic<uint64_t> generation{ 1 }; // ahead of the worker, so the start placement is built too
+	std::unique_ptr<Mesh> ready;
+	std::atomic<bool> stopping{ false };
+	std::thread thread;
+};
+
+#endif // PREVIEW_WORKER_H
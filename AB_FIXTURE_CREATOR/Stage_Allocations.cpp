@@ -0,0 +1,19 @@
+#include <cstdlib>
+#include <new>
+
+#include "Stage_Stats.h"
+
+// Replacement global allocation functions that count into stage_allocations
+// for the stats output. They must be defined in exactly one translation unit
+// per executable, so CMake adds this file to every tool when
+// FIXTURE_COUNT_ALLOCATIONS is on; without it the file compiles to nothing.
+
+#ifdef FIXTURE_COUNT_ALLOCATIONS
+void* operator new(std::size_t size) {
+	++stage_allocations;
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#endif
@@ -0,0 +1,215 @@
+#ifndef STAGE_STATS_H
+#define STAGE_STATS_H
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Fixture_Common.h"
+
+// Per-stage timing and counters for fixture generation.
+//
+//   Stage_Stats::instance().open("stats.jsonl");   // enables collection
+//   Stage_Stats::instance().begin_fixture(id);
+//   { Stage_Timer timer("boolean", &Result_Mesh); ... }
+//   Stage_Stats::instance().end_fixture();         // writes one JSON line
+//   Stage_Stats::instance().summary(std::cout);    // percentiles per stage
+//
+// A fixture is open on the thread that began it. A stage that finishes it on
+// another thread (the write-behind output) takes it along with
+// suspend_fixture() and continues it there with resume_fixture().
+//
+// While collection is off a Stage_Timer is a single branch on a bool.
+// Allocation counts need FIXTURE_COUNT_ALLOCATIONS, which compiles
+// Stage_Allocations.cpp (the counting global operator new) into every tool;
+// otherwise they are reported as -1.
+
+// Bumped by the replacement operator new in Stage_Allocations.cpp.
+inline thread_local long long stage_allocations = 0;
+
+// Text as the body of a JSON string: quotes, backslashes and control
+// characters escaped, everything else (UTF-8 included) as is.
+inline std::string json_escape(const std::string& text) {
+	std::string escaped;
+	for (char c : text) {
+		switch (c) {
+		case '"': escaped += "\\\""; break;
+		case '\\': escaped += "\\\\"; break;
+		case '\n': escaped += "\\n"; break;
+		case '\r': escaped += "\\r"; break;
+		case '\t': escaped += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				char code[8];
+				std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(c)));
+				escaped += code;
+			}
+			else {
+				escaped += c;
+			}
+		}
+	}
+	return escaped;
+}
+
+// Nearest-rank percentile of an ascending sorted sample, p in [0, 1].
+inline double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) return 0.0;
+	return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5))];
+}
+
+struct Stage_Record {
+	const char* stage;
+	double ms;
+	size_t vertices, faces;
+	long long allocations;
+};
+
+class Stage_Stats {
+public:
+	static Stage_Stats& instance() {
+		static Stage_Stats stats;
+		return stats;
+	}
+
+	bool enabled() const { return active; }
+
+	// Starts collecting; JSON lines go to jsonPath, or nowhere when it is empty.
+	bool open(const std::string& jsonPath) {
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!jsonPath.empty()) {
+			json.open(jsonPath, std::ios::out | std::ios::trunc);
+			if (!json) {
+				std::cerr << Red << "      Error: Cannot open stats file:  " << ColorEnd << jsonPath << std::endl;
+				return false;
+			}
+		}
+		active = true;
+		return true;
+	}
+
+	struct Fixture_Records {
+		std::string name;
+		std::vector<Stage_Record> records;
+		std::chrono::steady_clock::time_point start;
+		bool open = false;
+	};
+
+	void begin_fixture(const std::string& name) {
+		if (!active) return;
+		current().name = name;
+		current().records.clear();
+		current().start = std::chrono::steady_clock::now();
+		current().open = true;
+	}
+
+	// Takes the open fixture off this thread; end_fixture() here is then a no-op.
+	Fixture_Records suspend_fixture() {
+		Fixture_Records fixture = std::move(current());
+		current() = Fixture_Records();
+		return fixture;
+	}
+
+	void resume_fixture(Fixture_Records&& fixture) {
+		current() = std::move(fixture);
+	}
+
+	void record(const Stage_Record& r) {
+		current().records.push_back(r);
+	}
+
+	void end_fixture() {
+		if (!active || !current().open) return;
+		Fixture_Records& fixture = current();
+		double total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fixture.start).count();
+
+		std::ostringstream line;
+		line << std::fixed << std::setprecision(3) << "{\"fixture\":\"" << json_escape(fixture.name) << "\",\"total_ms\":" << total << ",\"stages\":[";
+		for (size_t i = 0; i < fixture.records.size(); ++i) {
+			const Stage_Record& r = fixture.records[i];
+			line << (i ? "," : "") << "{\"stage\":\"" << r.stage << "\",\"ms\":" << r.ms
+				<< ",\"vertices\":" << r.vertices << ",\"faces\":" << r.faces << ",\"allocations\":" << r.allocations << "}";
+		}
+		line << "]}";
+
+		std::lock_guard<std::mutex> lock(mtx);
+		if (json.is_open()) json << line.str() << std::endl;
+		for (const Stage_Record& r : fixture.records) durations[r.stage].push_back(r.ms);
+		durations["total"].push_back(total);
+		fixture.records.clear();
+		fixture.open = false;
+	}
+
+	void summary(std::ostream& os) {
+		if (!active) return;
+		std::lock_guard<std::mutex> lock(mtx);
+		os << Yellow << "      Stage            count     p50 ms     p90 ms     p99 ms     max ms" << ColorEnd << std::endl;
+		for (auto& entry : durations) {
+			std::vector<double>& values = entry.second;
+			std::sort(values.begin(), values.end());
+			os << "      " << std::left << std::setw(15) << entry.first << std::right << std::setw(7) << values.size()
+				<< std::fixed << std::setprecision(2)
+				<< std::setw(11) << percentile(values, 0.50) << std::setw(11) << percentile(values, 0.90)
+				<< std::setw(11) << percentile(values, 0.99) << std::setw(11) << values.back() << std::defaultfloat << std::endl;
+		}
+	}
+
+private:
+	static Fixture_Records& current() {
+		static thread_local Fixture_Records records;
+		return records;
+	}
+
+	bool active = false;
+	std::mutex mtx;
+	std::ofstream json;
+	std::map<std::string, std::vector<double>> durations;
+};
+
+// Times the enclosing scope as one stage of the current fixture. The mesh, if
+// given, is measured when the scope ends.
+class Stage_Timer {
+public:
+	explicit Stage_Timer(const char* stage, const Mesh* mesh = nullptr) : stage(stage), mesh(mesh) {
+		if (!Stage_Stats::instance().enabled()) return;
+		running = true;
+		allocations = stage_allocations;
+		start = std::chrono::steady_clock::now();
+	}
+
+	~Stage_Timer() {
+		if (!running) return;
+		Stage_Record r;
+		r.stage = stage;
+		r.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		r.vertices = mesh ? mesh->number_of_vertices() : 0;
+		r.faces = mesh ? mesh->number_of_faces() : 0;
+#ifdef FIXTURE_COUNT_ALLOCATIONS
+		r.allocations = stage_allocations - allocations;
+#else
+		r.allocations = -1;
+#endif
+		Stage_Stats::instance().record(r);
+	}
+
+	Stage_Timer(const Stage_Timer&) = delete;
+	Stage_Timer& operator=(const Stage_Timer&) = delete;
+
+private:
+	const char* stage;
+	const Mesh* mesh;
+	bool running = false;
+	long long allocations = 0;
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif // STAGE_STATS_H
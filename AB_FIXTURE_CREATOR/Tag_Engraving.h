@@ -0,0 +1,345 @@
+#ifndef TAG_ENGRAVING_H
+#define TAG_ENGRAVING_H
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <queue>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "Fixture_Common.h"
+#include "Glyph_Font.h"
+#include "Point_SoA.h"
+
+#include <CGAL/Constrained_Delaunay_triangulation_2.h>
+#include <CGAL/Triangulation_face_base_with_info_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+#include <CGAL/Polygon_mesh_processing/polygon_soup_to_polygon_mesh.h>
+
+// 2.5D engraving: the ID pockets as a planar operation on the tag plate.
+//
+// Every glyph is a prism (flat caps, straight or drafted walls) that is sunk
+// from above into a horizontal plate, so the 3D difference only changes the
+// plate faces above the glyph footprints. Those faces are taken out and their
+// outline is triangulated again in 2D together with the glyph outlines cut at
+// the plate height (a constrained Delaunay triangulation). The triangles
+// outside the glyphs become the new plate, the glyph bottom caps become the
+// pocket floors, and the glyph walls, cut at the plate, join the two. The
+// rest of the fixture is copied unchanged, so the result has the same shape
+// as the corefinement difference at a fraction of its cost.
+//
+// Anything the planar model does not cover (a glyph not fully under a flat
+// plate, glyphs touching each other, a fixture surface within the pocket
+// depth) returns false, and the caller runs the 3D boolean instead. With
+// FIXTURE_VALIDATE_ENGRAVING set in the environment the volume of every
+// engraved result is compared to the 3D boolean; FIXTURE_BENCH -CHECK does the
+// same for its IDs and fails when one of them falls back.
+
+// create_fixture tries the planar engraving first; false always runs the 3D boolean.
+inline bool ENGRAVE_2D = true;
+
+// create_fixture calls that engraved in 2D, and that fell back to the 3D boolean.
+inline std::atomic<long long> engraved_fixtures{ 0 }, engrave_fallbacks{ 0 };
+
+struct Engrave_Vertex_Info {
+	int id = -1;                                             // sequence number, for the edge sets
+	Vertex_index fixture = Mesh::null_vertex();              // plate outline vertex
+	int outline = -1;                                        // glyph outline vertex
+};
+
+struct Engrave_Face_Info {
+	bool visited = false, inPlate = false, inGlyph = false;
+};
+
+typedef CGAL::Triangulation_vertex_base_with_info_2<Engrave_Vertex_Info, Kernel> Engrave_Vb;
+typedef CGAL::Constrained_triangulation_face_base_2<Kernel> Engrave_Cfb;
+typedef CGAL::Triangulation_face_base_with_info_2<Engrave_Face_Info, Kernel, Engrave_Cfb> Engrave_Fb;
+typedef CGAL::Triangulation_data_structure_2<Engrave_Vb, Engrave_Fb> Engrave_Tds;
+typedef CGAL::Constrained_Delaunay_triangulation_2<Kernel, Engrave_Tds, CGAL::No_constraint_intersection_tag> Engrave_CDT;
+
+// One placed glyph: its wall loops in fixture coordinates, glyph on their left.
+struct Engrave_Glyph {
+	std::vector<std::vector<Glyph_Edge>> loops;
+	const std::vector<std::array<std::size_t, 3>>* floor = nullptr; // Glyph_Outline::floor
+	double floorZ = 0.0, topZ = 0.0;
+	CGAL::Bbox_2 box;
+};
+
+struct Engrave_Outlines {
+	std::vector<Engrave_Glyph> glyphs;
+	double floorZ = std::numeric_limits<double>::infinity();  // lowest floor
+	double topZ = -std::numeric_limits<double>::infinity();   // highest top
+};
+
+// Per-worker buffers of engrave_outlines: the plate maps, the rim and the
+// polygon soup. They are cleared, not freed, between fixtures, so after the
+// first fixture on a worker they come from the capacity the last one left.
+// engrave_outlines never waits on other tasks, so a worker cannot enter it
+// twice at once.
+struct Engrave_Scratch {
+	std::vector<bool> inPlate;
+	std::vector<std::pair<Engrave_CDT::Vertex_handle, Engrave_CDT::Vertex_handle>> plateEdges;
+	std::vector<Engrave_CDT::Vertex_handle> plateHandles, outlineHandles;
+	std::vector<Kernel::Point_2> outlinePoints;
+	std::vector<Point> points;
+	std::vector<std::array<std::size_t, 3>> triangles;
+	std::vector<std::size_t> fixtureIndex;
+
+	static Engrave_Scratch& local() {
+		static thread_local Engrave_Scratch scratch;
+		return scratch;
+	}
+};
+
+// Adds one placed glyph outline. The profile scales the two caps on their
+// own, as it does the glyph solid's vertices, so its walls stay planar.
+inline void glyph_outlines(const Glyph_Outline& outline, const Vector& offset, const Scale_Profile& profile, Engrave_Outlines& outlines) {
+	double bottomScale = profile.xy_scale(outline.zmin), topScale = profile.xy_scale(outline.zmax);
+	Engrave_Glyph glyph;
+	glyph.floor = &outline.floor;
+	glyph.floorZ = outline.zmin * profile.Zscale + offset.z();
+	glyph.topZ = outline.zmax * profile.Zscale + offset.z();
+	for (const auto& loop : outline.loops) {
+		std::vector<Glyph_Edge> placed;
+		placed.reserve(loop.size());
+		for (const Glyph_Edge& e : loop) {
+			placed.push_back({ Kernel::Point_2(e.bottom.x() * bottomScale + offset.x(), e.bottom.y() * bottomScale + offset.y()),
+				Kernel::Point_2(e.top.x() * topScale + offset.x(), e.top.y() * topScale + offset.y()) });
+			glyph.box += placed.back().bottom.bbox() + placed.back().top.bbox();
+		}
+		glyph.loops.push_back(std::move(placed));
+	}
+	outlines.floorZ = std::min(outlines.floorZ, glyph.floorZ);
+	outlines.topZ = std::max(outlines.topZ, glyph.topZ);
+	outlines.glyphs.push_back(std::move(glyph));
+}
+
+inline bool engrave_outlines(const Mesh& Fixture_Mesh, const Engrave_Outlines& outlines, Mesh& Result_Mesh) {
+	auto fallback = [](const char* reason) {
+		if (DEBUG) std::cout << Yellow << "      Engraving falls back to the 3D boolean:  " << ColorEnd << reason << std::endl;
+		return false;
+	};
+	if (Fixture_Mesh.has_garbage() || !CGAL::is_closed(Fixture_Mesh)) return fallback("fixture is not a closed compact mesh");
+
+	// Every fixture face reaching the pocket volume must be flat at one plate height.
+	const double floorZ = outlines.floorZ, topZ = outlines.topZ;
+	double plateZ = 0.0;
+	bool plateFound = false;
+	Engrave_Scratch& scratch = Engrave_Scratch::local();
+	std::vector<bool>& inPlate = scratch.inPlate;
+	inPlate.assign(Fixture_Mesh.num_faces(), false);
+	for (Face_index f : Fixture_Mesh.faces()) {
+		CGAL::Bbox_3 box;
+		for (Vertex_index v : vertices_around_face(Fixture_Mesh.halfedge(f), Fixture_Mesh)) box += Fixture_Mesh.point(v).bbox();
+		if (box.zmax() < floorZ || box.zmin() > topZ) continue;
+		CGAL::Bbox_2 flat(box.xmin(), box.ymin(), box.xmax(), box.ymax());
+		bool reaches = false;
+		for (const Engrave_Glyph& glyph : outlines.glyphs) reaches = reaches || CGAL::do_overlap(flat, glyph.box);
+		if (!reaches) continue;
+		if (box.zmin() != box.zmax() || (plateFound && box.zmin() != plateZ)) return fallback("tag plate is not flat");
+		plateZ = box.zmin();
+		plateFound = true;
+		inPlate[f] = true;
+	}
+	if (!plateFound) return fallback("glyphs do not cross the tag plate");
+	for (const Engrave_Glyph& glyph : outlines.glyphs) {
+		if (plateZ <= glyph.floorZ || plateZ >= glyph.topZ) return fallback("glyphs do not cross the tag plate");
+	}
+	// The floors stay apart when the glyph boxes do
+	for (std::size_t i = 0; i < outlines.glyphs.size(); ++i) {
+		for (std::size_t j = i + 1; j < outlines.glyphs.size(); ++j) {
+			if (CGAL::do_overlap(outlines.glyphs[i].box, outlines.glyphs[j].box)) return fallback("glyphs overlap");
+		}
+	}
+
+	// Plate outline and glyph outlines into one constrained triangulation. All
+	// points go in first, so any constraint crossing or touching another one
+	// throws instead of being split.
+	Engrave_CDT cdt;
+	int nextId = 0;
+	auto insert_point = [&](const Kernel::Point_2& p) {
+		Engrave_CDT::Vertex_handle handle = cdt.insert(p);
+		if (handle->info().id >= 0) return Engrave_CDT::Vertex_handle();
+		handle->info().id = nextId++;
+		return handle;
+	};
+
+	auto& plateEdges = scratch.plateEdges;
+	std::vector<Engrave_CDT::Vertex_handle>& plateHandles = scratch.plateHandles;
+	plateEdges.clear();
+	plateHandles.assign(Fixture_Mesh.num_vertices(), Engrave_CDT::Vertex_handle());
+	for (Face_index f : Fixture_Mesh.faces()) {
+		if (!inPlate[f]) continue;
+		for (Halfedge_index h : halfedges_around_face(Fixture_Mesh.halfedge(f), Fixture_Mesh)) {
+			if (inPlate[Fixture_Mesh.face(Fixture_Mesh.opposite(h))]) continue;
+			std::array<Vertex_index, 2> ends = { Fixture_Mesh.source(h), Fixture_Mesh.target(h) };
+			for (Vertex_index v : ends) {
+				if (plateHandles[v] != Engrave_CDT::Vertex_handle()) continue;
+				const Point& p = Fixture_Mesh.point(v);
+				plateHandles[v] = insert_point(Kernel::Point_2(p.x(), p.y()));
+				if (plateHandles[v] == Engrave_CDT::Vertex_handle()) return fallback("plate outline touches itself");
+				plateHandles[v]->info().fixture = v;
+			}
+			plateEdges.emplace_back(plateHandles[ends[0]], plateHandles[ends[1]]);
+		}
+	}
+
+	// The rim: every wall edge cut at the plate height
+	std::vector<Kernel::Point_2>& outlinePoints = scratch.outlinePoints;
+	std::vector<Engrave_CDT::Vertex_handle>& outlineHandles = scratch.outlineHandles;
+	outlinePoints.clear();
+	outlineHandles.clear();
+	for (const Engrave_Glyph& glyph : outlines.glyphs) {
+		double t = (plateZ - glyph.floorZ) / (glyph.topZ - glyph.floorZ);
+		for (const auto& loop : glyph.loops) {
+			for (const Glyph_Edge& e : loop) {
+				Kernel::Point_2 p = e.bottom + t * (e.top - e.bottom);
+				Engrave_CDT::Vertex_handle handle = insert_point(p);
+				if (handle == Engrave_CDT::Vertex_handle()) return fallback("glyph outline meets another outline");
+				handle->info().outline = static_cast<int>(outlinePoints.size());
+				outlinePoints.push_back(p);
+				outlineHandles.push_back(handle);
+			}
+		}
+	}
+
+	std::set<std::pair<int, int>> glyphEdges;
+	try {
+		for (const auto& edge : plateEdges) cdt.insert_constraint(edge.first, edge.second);
+		std::size_t first = 0;
+		for (const Engrave_Glyph& glyph : outlines.glyphs) {
+			for (const auto& loop : glyph.loops) {
+				for (std::size_t i = 0; i < loop.size(); ++i) {
+					Engrave_CDT::Vertex_handle a = outlineHandles[first + i], b = outlineHandles[first + (i + 1) % loop.size()];
+					cdt.insert_constraint(a, b);
+					glyphEdges.insert(std::minmax(a->info().id, b->info().id));
+				}
+				first += loop.size();
+			}
+		}
+	}
+	catch (const std::exception&) {
+		return fallback("glyph outline crosses the plate outline or another glyph");
+	}
+
+	// Flood fill from outside; crossing a plate edge toggles inPlate, a glyph edge inGlyph.
+	std::queue<Engrave_CDT::Face_handle> open;
+	cdt.infinite_face()->info().visited = true;
+	open.push(cdt.infinite_face());
+	while (!open.empty()) {
+		Engrave_CDT::Face_handle f = open.front();
+		open.pop();
+		for (int i = 0; i < 3; ++i) {
+			Engrave_CDT::Face_handle n = f->neighbor(i);
+			if (n->info().visited) continue;
+			n->info() = f->info();
+			if (f->is_constrained(i)) {
+				int a = f->vertex(cdt.cw(i))->info().id, b = f->vertex(cdt.ccw(i))->info().id;
+				if (glyphEdges.count(std::minmax(a, b))) n->info().inGlyph = !n->info().inGlyph;
+				else n->info().inPlate = !n->info().inPlate;
+			}
+			open.push(n);
+		}
+	}
+
+	// Polygon soup: the untouched fixture faces, then the new plate, floors and walls
+	std::vector<Point>& points = scratch.points;
+	std::vector<std::array<std::size_t, 3>>& triangles = scratch.triangles;
+	std::vector<std::size_t>& fixtureIndex = scratch.fixtureIndex;
+	points.clear();
+	triangles.clear();
+	fixtureIndex.assign(Fixture_Mesh.num_vertices(), std::numeric_limits<std::size_t>::max());
+	auto fixture_point = [&](Vertex_index v) {
+		std::size_t& index = fixtureIndex[v];
+		if (index == std::numeric_limits<std::size_t>::max()) {
+			index = points.size();
+			points.push_back(Fixture_Mesh.point(v));
+		}
+		return index;
+	};
+	triangles.reserve(Fixture_Mesh.num_faces() + 2 * cdt.number_of_faces() + 2 * outlinePoints.size());
+	for (Face_index f : Fixture_Mesh.faces()) {
+		if (inPlate[f]) continue;
+		std::array<std::size_t, 3> triangle;
+		int k = 0;
+		for (Vertex_index v : vertices_around_face(Fixture_Mesh.halfedge(f), Fixture_Mesh)) {
+			if (k == 3) return fallback("fixture is not triangulated");
+			triangle[k++] = fixture_point(v);
+		}
+		triangles.push_back(triangle);
+	}
+
+	std::size_t rimFirst = points.size();
+	for (const Kernel::Point_2& p : outlinePoints) points.emplace_back(p.x(), p.y(), plateZ);
+
+	// Inside the rim the plate is open; the pockets close it lower down.
+	for (Engrave_CDT::Finite_faces_iterator f = cdt.finite_faces_begin(); f != cdt.finite_faces_end(); ++f) {
+		if (!f->info().inPlate) {
+			if (f->info().inGlyph) return fallback("glyph reaches beyond the tag plate");
+			continue;
+		}
+		std::array<std::size_t, 3> triangle;
+		for (int k = 0; k < 3; ++k) {
+			const Engrave_Vertex_Info& info = f->vertex(k)->info();
+			if (f->info().inGlyph && info.outline < 0) return fallback("plate vertex inside a glyph");
+			triangle[k] = info.outline >= 0 ? rimFirst + info.outline : fixture_point(info.fixture);
+		}
+		if (!f->info().inGlyph) triangles.push_back(triangle);
+	}
+
+	// Each pocket: the glyph's bottom cap as the floor, and its walls from the
+	// floor up to the rim. A wall edge pair sharing its bottom point is one
+	// triangle, any other pair a quad.
+	std::size_t rim = rimFirst;
+	for (const Engrave_Glyph& glyph : outlines.glyphs) {
+		std::size_t floorFirst = points.size();
+		std::vector<Kernel::Point_2> floorPoints;
+		std::vector<std::vector<std::size_t>> floorIndex;
+		for (const auto& loop : glyph.loops) floorIndex.push_back(cap_points(loop, false, floorPoints));
+		for (const Kernel::Point_2& p : floorPoints) points.emplace_back(p.x(), p.y(), glyph.floorZ);
+		for (const auto& t : *glyph.floor) triangles.push_back({ floorFirst + t[0], floorFirst + t[1], floorFirst + t[2] });
+
+		for (std::size_t l = 0; l < glyph.loops.size(); ++l) {
+			const std::vector<std::size_t>& b = floorIndex[l];
+			for (std::size_t p = 0; p < b.size(); ++p) {
+				std::size_t q = (p + 1) % b.size();
+				if (b[p] != b[q]) triangles.push_back({ floorFirst + b[q], floorFirst + b[p], rim + p });
+				triangles.push_back({ floorFirst + b[q], rim + p, rim + q });
+			}
+			rim += b.size();
+		}
+	}
+
+	if (!PMP::is_polygon_soup_a_polygon_mesh(triangles)) return fallback("engraved faces do not form a manifold");
+	Result_Mesh.clear();
+	PMP::polygon_soup_to_polygon_mesh(points, triangles, Result_Mesh);
+	if (!CGAL::is_closed(Result_Mesh)) return fallback("engraved mesh is not closed");
+	if (DEBUG) std::cout << Yellow << "      Engraved in 2D:  " << ColorEnd << outlines.glyphs.size() << " glyphs, "
+		<< Result_Mesh.number_of_faces() << " faces" << std::endl;
+	return true;
+}
+
+// Engraves every placed glyph (anything with ->glyph and .offset) into the
+// fixture. False leaves Result_Mesh unspecified; run the 3D boolean then.
+template <typename Placements>
+bool engrave_tag(const Mesh& Fixture_Mesh, const Placements& placements, const Scale_Profile& profile, Mesh& Result_Mesh) {
+	if (!profile.valid()) return false;
+	Engrave_Outlines outlines;
+	for (const auto& placed : placements) {
+		if (!placed.glyph->hasOutline) {
+			if (DEBUG) std::cout << Yellow << "      Engraving falls back to the 3D boolean:  " << ColorEnd << "glyph is not a prism" << std::endl;
+			return false;
+		}
+		glyph_outlines(placed.glyph->outline, placed.offset, profile, outlines);
+	}
+	if (outlines.glyphs.empty()) return false;
+	return engrave_outlines(Fixture_Mesh, outlines, Result_Mesh);
+}
+
+#endif // TAG_ENGRAVING_H
@@ -0,0 +1,87 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// True on the worker threads of any Thread_Pool. Parallel sections started
+// from a pool job run inline (see Concurrency.h): the pool already spreads
+// the jobs over its threads, and a job waiting for work queued behind it
+// could block the pool.
+inline thread_local bool in_pool_task = false;
+
+// Fixed set of worker threads draining a FIFO of jobs. Jobs must not throw.
+class Thread_Pool {
+public:
+	explicit Thread_Pool(unsigned threads = 0) {
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned i = 0; i < threads; ++i) {
+			workers.emplace_back([this] { worker(); });
+		}
+	}
+
+	~Thread_Pool() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+		}
+		jobReady.notify_all();
+		for (auto& t : workers) t.join();
+	}
+
+	Thread_Pool(const Thread_Pool&) = delete;
+	Thread_Pool& operator=(const Thread_Pool&) = delete;
+
+	void enqueue(std::function<void()> job) {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			jobs.push_back(std::move(job));
+		}
+		jobReady.notify_one();
+	}
+
+	// Blocks until the queue is empty and no job is running.
+	void wait() {
+		std::unique_lock<std::mutex> lock(mtx);
+		jobsDone.wait(lock, [this] { return jobs.empty() && active == 0; });
+	}
+
+	unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+private:
+	void worker() {
+		in_pool_task = true;
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (jobs.empty()) return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+				++active;
+			}
+			job();
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				--active;
+				if (jobs.empty() && active == 0) jobsDone.notify_all();
+			}
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mtx;
+	std::condition_variable jobReady, jobsDone;
+	unsigned active = 0;
+	bool stopping = false;
+};
+
+#endif // THREAD_POOL_H
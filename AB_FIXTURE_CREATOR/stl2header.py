@@ -1,4 +1,5 @@
 import os
+import sys
 
 def sanitize_name(name):
     """Sanitizes the file name to be a valid C++ variable name by replacing invalid characters."""
@@ -22,7 +23,9 @@ const size_t {array_name}_Size = sizeof({array_name});
     
 def files_to_cpp_header(directory, output_filename):
     """Generates a C++ header file that embeds all .stl files in a directory as arrays."""
-    header_content = "#ifndef OCR_FONT_STL_H\n#define OCR_FONT_STL_H\n#pragma once\n#include <cstddef>\n#include <vector>\n\nstruct STLData {\n    std::string key;\n    const unsigned char* data;\n    size_t size;\n};\n\n"
+    # Plain pointers and sizes only, so the table is constant-initialized and
+    # costs nothing at startup; the STL bytes are decoded when first looked up.
+    header_content = "#ifndef OCR_FONT_STL_H\n#define OCR_FONT_STL_H\n#pragma once\n#include <cstddef>\n#include <cstring>\n\nstruct STLData {\n    const char* key;\n    const unsigned char* data;\n    size_t size;\n};\n\n"
     vector_entries = []
     for filename in sorted(os.listdir(directory)):
         if filename.lower().endswith(".stl"):
@@ -32,8 +35,15 @@ def files_to_cpp_header(directory, output_filename):
             header_content += file_to_cpp_array(input_filename, array_name)
             # Use the sanitized base filename as the key
             vector_entries.append(f'{{"{variable_base}", {array_name}, {array_name}_Size}}')
-    # Append the vector of STLData definitions to the header content
-    header_content += "\nstatic const std::vector<STLData> FONT_STL = {\n    " + ",\n    ".join(vector_entries) + "\n};\n\n#endif // OCR_FONT_STL_H\n"
+    # Append the table of STLData entries and its lookup to the header content
+    header_content += "\nstatic const STLData FONT_STL[] = {\n    " + ",\n    ".join(vector_entries) + "\n};\n\n"
+    header_content += ("// Null when nothing is embedded under that key.\n"
+                       "inline const STLData* find_STL_data(const char* key) {\n"
+                       "    for (const STLData& data : FONT_STL) {\n"
+                       "        if (std::strcmp(data.key, key) == 0) return &data;\n"
+                       "    }\n"
+                       "    return nullptr;\n"
+                       "}\n\n#endif // OCR_FONT_STL_H\n")
     # Write the combined content to the output header file
     try:
         with open(output_filename, 'w') as file:
@@ -47,4 +57,7 @@ if __name__ == "__main__":
     script_dir = os.path.dirname(os.path.abspath(__file__))
     directory_path = os.path.join(script_dir, 'models')
     output_header = os.path.join(script_dir, 'OCR_font_STL.h')
+    # Build systems pass the models folder and the header to generate
+    if len(sys.argv) == 3:
+        directory_path, output_header = sys.argv[1], sys.argv[2]
     files_to_cpp_header(directory_path, output_header)